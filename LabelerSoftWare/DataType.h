@@ -20,4 +20,13 @@ public:
   string imgExtension;
   int extractBoundary;
   SuperpixelScales superpixel_scales;
+  string superpixel_algorithm;//SLIC or MeanShift
+  int superpixel_hierarchical;//0: independent SLIC per scale, 1: merge coarser scales from the finest
+  int superpixel_temporal;//1: warm start SLIC from the seeds of the previously segmented frame
+  int superpixel_max_iterations;//SLIC iteration cap
+  double superpixel_tolerance;//SLIC stops once the mean centroid movement (pixels) is below, 0: always run the cap
+  int superpixel_precompute_frames;//frames after the labeled one segmented in the background, 0: none
+  int superpixel_disk_cache;//1: keep label images of visited frames in the user cache directory
+  int superpixel_disk_cache_limit;//MB of the superpixel cache, least recently used frames are pruned beyond
+  int superpixel_boundary_thickness;//width of the dark band around superpixel boundaries, 0: boundary line only
 };
\ No newline at end of file
@@ -16,13 +16,52 @@
 #include <QString>
 #include <QtConcurrent>
 #include <numeric>
+#include <algorithm>
+#include <cstring>
+
+//SSE2 compare for canvas restricted fills, always there on x64 builds.
+//Define LABEL_NO_SIMD to force the scalar loop.
+#if !defined(LABEL_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LABEL_SIMD_SSE2
+#include <emmintrin.h>
+#endif
 
 //#define CHECK_RETRIEVE_PAINTERPATH
+const int TEMPORAL_MOTION_SIZE = 256;//longer side of the image used for the global motion estimate
+const double TEMPORAL_MIN_RESPONSE = 0.1;//weaker phase correlation peaks restart SLIC from a grid
 //#define CHECK_MASK_OUTPUTIMAGE
 //#define CHECK_QIMAGE
 #ifdef CHECK_QIMAGE
 #include <QtDebug.h>
 #endif // CHECK_QIMAGE
+const int PARALLEL_FILL_PIXELS = 1 << 16;//fills and renders of fewer pixels stay on the calling thread
+/*unlabeled pixels: class 0 in the class plane, black in the coloured result.
+Every colour maps to one class, so the two results load back to the same plane*/
+const uchar UNLABELED_CLASS = 0;
+const cv::Vec3b UNLABELED_COLOR(0, 0, 0);
+
+namespace
+{
+	/*class to cls where it is canvas, 16 pixels a step*/
+	void fillRunOnCanvas(uchar* c, int length, uchar canvas, uchar cls)
+	{
+		int k = 0;
+#ifdef LABEL_SIMD_SSE2
+		const __m128i vcanvas = _mm_set1_epi8((char)canvas);
+		const __m128i vcls = _mm_set1_epi8((char)cls);
+		for (; k + 16 <= length; k += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(c + k));
+			__m128i hit = _mm_cmpeq_epi8(v, vcanvas);
+			_mm_storeu_si128((__m128i*)(c + k), _mm_or_si128(_mm_and_si128(hit, vcls), _mm_andnot_si128(hit, v)));
+		}
+#endif
+		for (; k < length; k++)
+		{
+			if (c[k] == canvas) c[k] = cls;
+		}
+	}
+}
 
 
 LabelingTaskControl::LabelingTaskControl(ProcessControl* pProcCtrl,VideoControl* pCtrl, ClassSelection* selection, QString outPutDir,bool autoLoadResult, QObject* parent) :QObject(parent)
@@ -33,6 +72,9 @@ LabelingTaskControl::LabelingTaskControl(ProcessControl* pProcCtrl,VideoControl*
 	_pVidCtrl = pCtrl;
 	_segSurfaceSet = false;
 	_curSegmentation_control = nullptr;
+	_requestedLevel = 0;
+	_segProgress = NULL;
+	_motionScale = 1.0;
   this->_canvas_idx = 0;
 	/*_pVidCtrl->reset(_pVidCtrl->getPosFrames());*/
 	int index = _pVidCtrl->getPosFrames();
@@ -50,11 +92,21 @@ qDebug() <<"index:" <<_pVidCtrl->getPosFrames();
 	_outPutDir = outPutDir;
 	_InputImg = Img.copy();
 	_selection = selection;
+	setupClassLookup();
   auto& sp_scales = _pCtrl->get_superpixel_scales();
-	_segmentation_controls.push_back(new SegmentationControl(matFrame, sp_scales[0]));
-	_segmentation_controls.push_back(new SegmentationControl(matFrame, sp_scales[1]));
-	_segmentation_controls.push_back(new SegmentationControl(matFrame, sp_scales[2]));
-	_segmentation_controls.push_back(new SegmentationControl(matFrame, sp_scales[3]));
+	//all scales read the same LAB planes and edge map, computed once by the first SLIC job of the frame
+	PtrSharedSlicInput slicInput(new SharedSlicInput(matFrame, _pCtrl->getSlicArena()));
+	for (size_t i = 0; i < sp_scales.size(); i++)
+	{
+		_segmentation_controls.push_back(new SegmentationControl(matFrame, sp_scales[i], slicInput));
+		_segmentation_controls[i]->setSlicArena(_pCtrl->getSlicArena());
+		_segmentation_controls[i]->setSlicIterationControl(_pCtrl->get_superpixel_max_iterations(), _pCtrl->get_superpixel_tolerance());
+		_segmentation_controls[i]->setSlicBoundaryThickness(_pCtrl->get_superpixel_boundary_thickness());
+	}
+	if (_pCtrl->get_superpixel_temporal())
+		_motionFrame = createMotionFrame(matFrame, _motionScale);
+	//the labeling interval the user set, in effect after setToSavedSkipFrameNum()
+	_pCtrl->getSuperpixelPrecompute()->schedule(index, _pVidCtrl->getSkipFrameNum());
 	//_segmentation_control->doSlicSegmentation();
 	//std::thread t(&SegmentationControl::doSlicSegmentation, _segmentation_control);
 	//_segmentation_control->setSegmentationType(SegmentationControl::SLIC_);
@@ -87,9 +139,9 @@ qDebug() <<"index:" <<_pVidCtrl->getPosFrames();
 qDebug() <<"index:" <<_pVidCtrl->getPosFrames();
 	_surfaceOriginal->setAllowPolyMode(true);
 	//_surfaceSegmentation->setDrawType(Surface::DRAW_TYPE::SUPER_PIXEL_WISE);
-	//QObject::connect(_segmentation_control, SIGNAL(signalSendPts(vector<PtrSegmentPoints>*)), _surfaceSegmentation, SLOT(slotPixelCovered(vector<PtrSegmentPoints>*)));
+	//QObject::connect(_segmentation_control, SIGNAL(signalSendPts(const SegmentIndex*, vector<int>*)), _surfaceSegmentation, SLOT(slotPixelCovered(const SegmentIndex*, vector<int>*)));
 	//QObject::connect(_surfaceSegmentation, SIGNAL(signalPixelCovered(vector<Point>*)), _segmentation_control, SLOT(slotReceivePts(vector<Point>*)));
-	//QObject::connect(_surfaceSegmentation, SIGNAL(signalDrawPixelsToResult(vector<PtrSegmentPoints>*, QColor)), this, SLOT(retrieveSegmentsDraw(vector<PtrSegmentPoints>*, QColor)));
+	//QObject::connect(_surfaceSegmentation, SIGNAL(signalDrawPixelsToResult(const SegmentIndex*, vector<int>*, QColor)), this, SLOT(retrieveSegmentsDraw(const SegmentIndex*, vector<int>*, QColor)));
 	QObject::connect(_surfaceOriginal, SIGNAL(signalSendPolygonDraw(vector<Point>, QColor)), this, SLOT(retrievePolygonDraw(vector<Point>, QColor)));
 	
 	_SA1 = new SmartScrollArea();
@@ -143,6 +195,41 @@ qDebug() <<"index:" <<_pVidCtrl->getPosFrames();
 LabelingTaskControl::~LabelingTaskControl()
 {
 	//if (_segmentation_control) { delete _segmentation_control; _segmentation_control = NULL; }
+	//levels not started yet are dropped, finished ones whose slot has not run yet are counted here
+	_pendingLevels.clear();
+	vector<QFuture<void> > running;
+	int runningNum = 0;
+	for (size_t k = 0; k < _segWatchers.size(); k++)
+	{
+		_segWatchers[k]->disconnect(this);
+		if (_segWatchers[k]->future().isFinished())
+		{
+			for (size_t i = 0; i < _segWatcherLevels[k].size(); i++) _levelReady[_segWatcherLevels[k][i]] = true;
+		}
+		else
+		{
+			running.push_back(_segWatchers[k]->future());
+			runningNum += _segWatcherLevels[k].size();
+		}
+	}
+	if (!_segWatchers.empty())
+	{
+		int readyNum = std::count(_levelReady.begin(), _levelReady.end(), true);
+		bool complete = readyNum + runningNum == int(_levelReady.size());
+		if (running.empty())
+		{
+			if (complete) storeSegmentation();
+		}
+		else
+		{
+			//not waited for on the GUI thread: a job stores the frame if the running levels complete it,
+			//and the temporal warm start of the next frame waits for that job instead
+			_pCtrl->addSegmentationFinishing(QtConcurrent::run(finishSegmentation, running, _segmentation_controls,
+				complete ? _frameIdx : -1, _pCtrl, _motionFrame));
+			_segmentation_controls.clear();
+		}
+	}
+	if (_segProgress) delete _segProgress;
 	for (size_t i = 0; i < _segmentation_controls.size(); i++)
 	{
 		delete _segmentation_controls[i];
@@ -154,57 +241,186 @@ LabelingTaskControl::~LabelingTaskControl()
 
 void LabelingTaskControl::setupSegmentationSurface(int level)
 {
+	if (_segmentation_controls.empty()) return;
 	level = qMax<int>(0, level);
-	level = qMin<int>(_segmentation_controls.size(), level);
-	if (!_segSurfaceSet)
+	level = qMin<int>(_segmentation_controls.size() - 1, level);
+	_requestedLevel = level;
+	if (_levelReady.empty()) startSegmentation();
+	//a level still being segmented is shown by slotSegmentationFinished
+	if (_levelReady[level]) showSegmentationLevel(level);
+	else
 	{
-		vector<QFuture<void>> vecThreads;
-    //QLabel* progress_widget = new QLabel();
-    //progress_widget->setWindowTitle("SLIC segmentation");
-    //progress_widget->setMinimumHeight(50);
-    //progress_widget->setFixedWidth(200);
-    QProgressBar* progress = new QProgressBar();
-    progress->setWindowTitle("Please wait for SLIC segmentation.");
-    progress->show();
-    progress->setMaximum(4);
-    progress->setMinimum(0);
-    progress->setValue(0);
-    progress->setMinimumWidth(500);
-    progress->setMinimumHeight(50);
-    progress->setAlignment(Qt::AlignCenter);
-    progress->setFormat(QString("Processing SLIC segmentation..."));
+		//not started yet: run it next, at full priority
+		std::deque<int>::iterator pending = std::find(_pendingLevels.begin(), _pendingLevels.end(), level);
+		if (pending != _pendingLevels.end())
+		{
+			_pendingLevels.erase(pending);
+			_pendingLevels.push_front(level);
+		}
+	}
+}
 
+void LabelingTaskControl::startSegmentation()
+{
+	_levelReady.assign(_segmentation_controls.size(), false);
+	vector<Mat> precomputed;
+	if (_pCtrl->getSuperpixelPrecompute()->fetch(_frameIdx, precomputed)
+		|| _pCtrl->getSuperpixelDiskCache()->loadFrame(_frameIdx, precomputed))
+	{
+		//segmented in the background while an earlier frame was being labeled, or on an earlier visit
+		for (size_t i = 0; i < _segmentation_controls.size() && i < precomputed.size(); i++)
+		{
+			_segmentation_controls[i]->setLabelImage(precomputed[i], _pCtrl->getSuperpixelType());
+			_levelReady[i] = true;
+		}
+		return;
+	}
+	_segProgress = new QProgressBar();
+	_segProgress->setWindowTitle("Please wait for superpixel segmentation.");
+	_segProgress->setMaximum(_segmentation_controls.size());
+	_segProgress->setMinimum(0);
+	_segProgress->setValue(0);
+	_segProgress->setMinimumWidth(500);
+	_segProgress->setMinimumHeight(50);
+	_segProgress->setAlignment(Qt::AlignCenter);
+	_segProgress->setFormat(QString("Processing superpixel segmentation... %v/%m"));
+	_segProgress->show();
+	if (!_pCtrl->get_superpixel_hierarchical())
+	{
+		//one level at a time, the segmenters are parallel inside: the requested level first on all cores,
+		//then the others in the background
+		_pendingLevels.assign(1, _requestedLevel);
 		for (size_t i = 0; i < _segmentation_controls.size(); i++)
 		{
-			_segmentation_controls[i]->setSegmentationType(SegmentationControl::SLIC_);
-			QFuture<void> t = QtConcurrent::run(_segmentation_controls[i],&SegmentationControl::doSlicSegmentation);
-			vecThreads.push_back(std::move(t));
+			if (int(i) != _requestedLevel) _pendingLevels.push_back(int(i));
 		}
-    std::vector<int> isReady(4,0);
-    int readyNum = 0;
-    int newreadyNum = 0;
-    while (true)
-    {
-      bool allTrue = true;
-      for (int i = 0; i < 4; i++)
-      {
-        if (vecThreads[i].isFinished() == false) allTrue = false;
-        else isReady[i] = 1;
-      }
-      if (allTrue) break;
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-      newreadyNum = std::accumulate(isReady.begin(),isReady.end(),0);
-      if (readyNum != newreadyNum) { readyNum = newreadyNum; progress->setValue(readyNum); }
-      QCoreApplication::processEvents();
-    }
-		
-    progress->setFormat(QString("Done!"));
-    progress->setValue(4);
-    progress->deleteLater();
-    
-		//t.join();
+	}
+	if (_pCtrl->get_superpixel_temporal())
+	{
+		//a job that finishes no level, the levels start from its slot
+		watchSegmentation(QtConcurrent::run(temporalWarmStart, _pCtrl, _motionFrame, _motionScale, _segmentation_controls,
+			_pCtrl->getSegmentationFinishing()), vector<int>());
+	}
+	else
+	{
+		startSegmentationJobs();
+	}
+}
+
+void LabelingTaskControl::startSegmentationJobs()
+{
+	if (_pCtrl->get_superpixel_hierarchical())
+	{
+		//one SLIC at the finest scale, the coarser scales are merged from it
+		vector<int> levels;
+		for (size_t i = 0; i < _segmentation_controls.size(); i++) levels.push_back(int(i));
+		watchSegmentation(QtConcurrent::run(&SegmentationControl::doHierarchicalSlicSegmentation, _segmentation_controls), levels);
+	}
+	else
+	{
+		startNextLevel();
+	}
+}
+
+void LabelingTaskControl::startNextLevel()
+{
+	if (_pendingLevels.empty()) return;
+	int level = _pendingLevels.front();
+	_pendingLevels.pop_front();
+	SegmentationControl* ctrl = _segmentation_controls[level];
+	SegmentationControl::segmentationType type = _pCtrl->getSuperpixelType();
+	if (level == _requestedLevel)
+		watchSegmentation(QtConcurrent::run(ctrl, &SegmentationControl::processSegmentation, type), vector<int>(1, level));
+	else
+		watchSegmentation(QtConcurrent::run(ctrl, &SegmentationControl::processBackgroundSegmentation, type), vector<int>(1, level));
+}
+
+void LabelingTaskControl::watchSegmentation(const QFuture<void>& future, const vector<int>& levels)
+{
+	QFutureWatcher<void>* watcher = new QFutureWatcher<void>(this);
+	QObject::connect(watcher, SIGNAL(finished()), this, SLOT(slotSegmentationFinished()));
+	_segWatchers.push_back(watcher);
+	_segWatcherLevels.push_back(levels);
+	watcher->setFuture(future);
+}
+
+void LabelingTaskControl::finishSegmentation(vector<QFuture<void> > running, vector<SegmentationControl*> controls, int frameIdx,
+	ProcessControl* pCtrl, Mat motionFrame)
+{
+	for (size_t k = 0; k < running.size(); k++) running[k].waitForFinished();
+	if (frameIdx >= 0)
+	{
+		if (pCtrl->get_superpixel_temporal() && !motionFrame.empty())
+		{
+			vector<PtrSlicSeeds> seeds;
+			for (size_t i = 0; i < controls.size(); i++) seeds.push_back(controls[i]->getSlicSeeds());
+			pCtrl->set_temporal_seeds(seeds);
+			pCtrl->set_temporal_frame(motionFrame);
+		}
+		vector<Mat> labels;
+		for (size_t i = 0; i < controls.size(); i++) labels.push_back(controls[i]->getLabelImage());
+		pCtrl->getSuperpixelDiskCache()->storeFrame(frameIdx, labels);
+	}
+	//the controls live in the GUI thread
+	for (size_t i = 0; i < controls.size(); i++) controls[i]->deleteLater();
+}
+
+void LabelingTaskControl::storeSegmentation()
+{
+	storeTemporalSeeds();
+	vector<Mat> labels;
+	for (size_t i = 0; i < _segmentation_controls.size(); i++)
+	{
+		labels.push_back(_segmentation_controls[i]->getLabelImage());
+	}
+	_pCtrl->getSuperpixelDiskCache()->storeFrameLater(_frameIdx, labels);
+}
+
+void LabelingTaskControl::slotSegmentationFinished()
+{
+	QFutureWatcher<void>* watcher = static_cast<QFutureWatcher<void>*>(sender());
+	bool requestedReady = false;
+	bool warmStarted = false;
+	for (size_t k = 0; k < _segWatchers.size(); k++)
+	{
+		if (_segWatchers[k] != watcher) continue;
+		warmStarted = _segWatcherLevels[k].empty();
+		for (size_t i = 0; i < _segWatcherLevels[k].size(); i++)
+		{
+			int level = _segWatcherLevels[k][i];
+			_levelReady[level] = true;
+			if (level == _requestedLevel) requestedReady = true;
+		}
+	}
+	int readyNum = std::count(_levelReady.begin(), _levelReady.end(), true);
+	if (_segProgress) _segProgress->setValue(readyNum);
+	if (requestedReady) showSegmentationLevel(_requestedLevel);
+	if (warmStarted)
+		startSegmentationJobs();
+	else
+		startNextLevel();
+	if (readyNum < int(_levelReady.size())) return;
+
+	storeSegmentation();
+	for (size_t k = 0; k < _segWatchers.size(); k++)
+	{
+		_segWatchers[k]->deleteLater();
+	}
+	_segWatchers.clear();
+	_segWatcherLevels.clear();
+	if (_segProgress)
+	{
+		_segProgress->deleteLater();
+		_segProgress = NULL;
+	}
+}
+
+void LabelingTaskControl::showSegmentationLevel(int level)
+{
+	if (!_segSurfaceSet)
+	{
 		_curSegmentation_control = _segmentation_controls[level];
-		_segImg = createQImageByMat(_curSegmentation_control->getSlicSegResultRef(), true);//set segImg
+		_segImg = createQImageByMat(_curSegmentation_control->getSegResultRef(), true);//set segImg
 		//_surfaceSegmentation = new Surface(_segImg);
    
     _surfaceSegmentation = new Surface(_InputImg);
@@ -213,9 +429,10 @@ void LabelingTaskControl::setupSegmentationSurface(int level)
 		//_surfaceSegmentation->setReferenceOriginalImage(&_surfaceOriginal->getOriImage());//_InputImg
     _surfaceSegmentation->setReferenceOriginalImage(&_segImg);
 		_surfaceSegmentation->setDrawType(Surface::DRAW_TYPE::SUPER_PIXEL_WISE);
-		QObject::connect(_curSegmentation_control, SIGNAL(signalSendPts(vector<PtrSegmentPoints>*)), _surfaceSegmentation, SLOT(slotPixelCovered(vector<PtrSegmentPoints>*)));
+		QObject::connect(_curSegmentation_control, SIGNAL(signalSendPts(const SegmentIndex*, vector<int>*)), _surfaceSegmentation, SLOT(slotPixelCovered(const SegmentIndex*, vector<int>*)));
 		QObject::connect(_surfaceSegmentation, SIGNAL(signalPixelCovered(vector<Point>*)), _curSegmentation_control, SLOT(slotReceivePts(vector<Point>*)));
-		QObject::connect(_surfaceSegmentation, SIGNAL(signalDrawPixelsToResult(vector<PtrSegmentPoints>*, QColor)), this, SLOT(retrieveSegmentsDraw(vector<PtrSegmentPoints>*, QColor)));
+		QObject::connect(_surfaceSegmentation, SIGNAL(signalBrushMoved(int, int, int)), _curSegmentation_control, SLOT(slotReceiveBrush(int, int, int)));
+		QObject::connect(_surfaceSegmentation, SIGNAL(signalDrawPixelsToResult(const SegmentIndex*, vector<int>*, QColor)), this, SLOT(retrieveSegmentsDraw(const SegmentIndex*, vector<int>*, QColor)));
 		_SA2->setWidget(_surfaceSegmentation);
 		_surfaceSegmentation->setScrollArea(_SA2);
 		_SA2->installEventFilter(_surfaceSegmentation);
@@ -243,7 +460,7 @@ void LabelingTaskControl::setupSegmentationSurface(int level)
 			_surfaceSegmentation->deleteLater();
 	
 			_curSegmentation_control = _segmentation_controls[level];
-			_segImg = createQImageByMat(_curSegmentation_control->getSlicSegResultRef(), true);//set segImg
+			_segImg = createQImageByMat(_curSegmentation_control->getSegResultRef(), true);//set segImg
 			//_surfaceSegmentation = new Surface(_segImg);
       _surfaceSegmentation = new Surface(_InputImg);
 			_surfaceSegmentation->setBlendAlpha(blendRatioSrc, blendRatioRef);
@@ -251,9 +468,10 @@ void LabelingTaskControl::setupSegmentationSurface(int level)
 			//_surfaceSegmentation->setReferenceOriginalImage(&_surfaceOriginal->getOriImage());//_InputImg
       _surfaceSegmentation->setReferenceOriginalImage(&_segImg);
 			_surfaceSegmentation->setDrawType(Surface::DRAW_TYPE::SUPER_PIXEL_WISE);
-			QObject::connect(_curSegmentation_control, SIGNAL(signalSendPts(vector<PtrSegmentPoints>*)), _surfaceSegmentation, SLOT(slotPixelCovered(vector<PtrSegmentPoints>*)));
+			QObject::connect(_curSegmentation_control, SIGNAL(signalSendPts(const SegmentIndex*, vector<int>*)), _surfaceSegmentation, SLOT(slotPixelCovered(const SegmentIndex*, vector<int>*)));
 			QObject::connect(_surfaceSegmentation, SIGNAL(signalPixelCovered(vector<Point>*)), _curSegmentation_control, SLOT(slotReceivePts(vector<Point>*)));
-			QObject::connect(_surfaceSegmentation, SIGNAL(signalDrawPixelsToResult(vector<PtrSegmentPoints>*, QColor)), this, SLOT(retrieveSegmentsDraw(vector<PtrSegmentPoints>*, QColor)));
+			QObject::connect(_surfaceSegmentation, SIGNAL(signalBrushMoved(int, int, int)), _curSegmentation_control, SLOT(slotReceiveBrush(int, int, int)));
+			QObject::connect(_surfaceSegmentation, SIGNAL(signalDrawPixelsToResult(const SegmentIndex*, vector<int>*, QColor)), this, SLOT(retrieveSegmentsDraw(const SegmentIndex*, vector<int>*, QColor)));
 			_SA2->setWidget(_surfaceSegmentation);
 			_surfaceSegmentation->setScrollArea(_SA2);
 			_SA2->installEventFilter(_surfaceSegmentation);
@@ -415,18 +633,26 @@ bool LabelingTaskControl::saveResult(QString filePath, bool saveOriginalImg)
 	/*The RGB color order is different, need to switch R and B*/
 	Mat ImgRvt;
 	cv::cvtColor(Img, ImgRvt, CV_RGB2BGR);
-	bool bsave = cv::imwrite(filePath.toStdString(), ImgRvt);
+	/*class indices first, always png so they stay exact: a coloured result is never left
+	newer than the indices it is checked against when loading*/
+	QString failedPath = getIndexIMGSavingPathName();
+	bool bsave = cv::imwrite(failedPath.toStdString(), _classImg);
+	if (bsave)
+	{
+		failedPath = filePath;
+		bsave = cv::imwrite(filePath.toStdString(), ImgRvt);
+	}
   int extractBoundary = _pCtrl->get_extractBoundary();
   if (extractBoundary != 0)
   {
 
   }
-	qDebug() << "File Saved To: " << filePath;
 	if (!bsave)
 	{
-		QMessageBox::warning(NULL, "Fail to Save", "Cannot save the result!!", QMessageBox::StandardButton::Close);
+		QMessageBox::warning(NULL, "Fail to Save", "Cannot save the result to " + failedPath + "!!", QMessageBox::StandardButton::Close);
 		return bsave;
 	}
+	qDebug() << "File Saved To: " << filePath;
 	if(saveOriginalImg)
 	{
 		QString oriIMG = getOriginalIMGSavingPathName();
@@ -495,6 +721,13 @@ QString LabelingTaskControl::getOriginalIMGSavingPathName()
   return QString(this->_outPutDir + QString("/%1_ori." + ext)).arg(QString(buff));
 }
 
+QString LabelingTaskControl::getIndexIMGSavingPathName()
+{
+  char buff[10];
+  sprintf(buff,"%06d", _frameIdx);
+  return QString(this->_outPutDir + QString("/%1_idx.png")).arg(QString(buff));
+}
+
 void LabelingTaskControl::openSaveDir()
 {
 	QDesktopServices::openUrl(QUrl::fromLocalFile(this->_outPutDir));
@@ -503,20 +736,7 @@ void LabelingTaskControl::openSaveDir()
 bool LabelingTaskControl::checkModified()
 {
 	//TODO need to check correction
-	QImage pImg = _surfaceOutPut->getImage();
-	Mat Img = ImageConversion::QImage_to_cvMat(pImg, false);
-	for (size_t j = 0; j < Img.rows; j++)
-	{
-		assert(Img.type() == CV_8UC3);
-		Vec3b* pVec = Img.ptr<Vec3b>(j);
-		for (size_t i = 0; i < Img.cols; i++)
-		{
-			if (pVec[i][0] != 0) return true;
-			if (pVec[i][1] != 0) return true;
-			if (pVec[i][2] != 0) return true;
-		}
-	}
-	return false;
+	return cv::countNonZero(_classImg != UNLABELED_CLASS) > 0;
 }
 
 void LabelingTaskControl::releaseAll()
@@ -524,6 +744,7 @@ void LabelingTaskControl::releaseAll()
 	_segImg = QImage();
 	_labelImg = Mat();
 	_outPutImg = QImage();
+	_classImg = Mat();
 	_painterPathImage = QImage();
 }
 
@@ -534,18 +755,29 @@ void LabelingTaskControl::setupOtherImg()
 	_labelImg = Mat(_InputImg.height(), _InputImg.width(), CV_32S);
 	//_segImg.fill(0);
 	_painterPathImage.fill(0);
+	_boundingRect = QRect();
 	_labelImg.setTo(0);
 	
 	_outPutImg = QImage(_InputImg.width(), _InputImg.height(), QImage::Format::Format_RGB888);
-	_outPutImg.fill(0);
+	_classImg = Mat(_InputImg.height(), _InputImg.width(), CV_8U, cv::Scalar(UNLABELED_CLASS));
+	renderOutPutImg();
 
 }
 
 void LabelingTaskControl::retrievePainterPath(int PenWidth, QPainterPath& paintPath)
 {
 	qDebug() << "To retrievePainterPath";
-	_painterPathImage.fill(0);
+	/*only the rect under the stroke is touched: the mask of the previous stroke is cleared
+	where it was drawn, the stroke bounds are grown by half the pen*/
+	int margin = PenWidth / 2 + 1;
+	QRect dirtyRect = paintPath.boundingRect().toAlignedRect().adjusted(-margin, -margin, margin, margin) & _painterPathImage.rect();
+	Mat pathImg = ImageConversion::QImage_to_cvMat(_painterPathImage, false);
+	if (!_boundingRect.isEmpty())
+		pathImg(cv::Rect(_boundingRect.x(), _boundingRect.y(), _boundingRect.width(), _boundingRect.height())).setTo(0);
+	_boundingRect = dirtyRect;
+	if (dirtyRect.isEmpty()) return;
 	QPainter painter(&_painterPathImage);
+	painter.setClipRect(dirtyRect);
 	painter.setPen(QPen(QColor(255,255,255), PenWidth, Qt::SolidLine, Qt::RoundCap,
 		Qt::RoundJoin));
 	painter.drawPath(paintPath);
@@ -556,40 +788,30 @@ void LabelingTaskControl::retrievePainterPath(int PenWidth, QPainterPath& paintP
 	cv::waitKey(1);
 #endif
 	updateImgByTouchedSegments(_painterPathImage);
-	_boundingRect = paintPath.boundingRect().toRect().adjusted(-1, -1, 1, 1);
 	
 	updateOutPutImg(_boundingRect, _painterPathImage);
 }
 
 void LabelingTaskControl::updateOutPutImg(QRect boundingRect, QImage& mask)
 {
-  Mat outPutImg = ImageConversion::QImage_to_cvMat(_outPutImg, false);
-  Mat maskImg = ImageConversion::QImage_to_cvMat(mask, false);
+  /*the class write, the canvas filter and the bbox scan all work on the rect of the stroke*/
+  cv::Rect roi = cv::Rect(boundingRect.x(), boundingRect.y(), boundingRect.width(), boundingRect.height()) & cv::Rect(0, 0, _classImg.cols, _classImg.rows);
+  if (roi.empty()) return;
+  Mat maskImg = ImageConversion::QImage_to_cvMat(mask, false)(roi);
 
-  qDebug() << CV_8UC3 << "==" << maskImg.type();
   QColor clr = _selection->getCurrentColor();
   if (this->_canvas_idx > 0)
   {
-    Mat mask = this->getClrMask(this->_canvasColor, outPutImg);
-    maskImg = maskImg&mask;
-    outPutImg.setTo(Vec3b(clr.red(), clr.green(), clr.blue()), maskImg);
-  }
-  else
-  {
-    outPutImg.setTo(Vec3b(clr.red(), clr.green(), clr.blue()), maskImg);
+    maskImg = maskImg&getCanvasMask(roi);
   }
+  _classImg(roi).setTo(getClassIndexByColor(clr), maskImg);
 
 #ifdef CHECK_MASK_OUTPUTIMAGE
-	cv::imshow("CHECK_MASK_OUTPUTIMAGE outPutImg", outPutImg);
+	cv::imshow("CHECK_MASK_OUTPUTIMAGE classImg", _classImg(roi));
 	cv::imshow("CHECK_MASK_OUTPUTIMAGE maskImg", maskImg);
 	cv::waitKey(500);
 #endif
-	//qDebug() << "To get Rect";
-	//qDebug() << "maskImg.rows:" << maskImg.rows;
-	//qDebug() << "maskImg.cols:" << maskImg.cols;
-	//qDebug() << "mask.rows:" << mask.height();
-	//qDebug() << "mask.cols:" << mask.width();
-	int min_x = maskImg.cols, min_y = maskImg.rows, max_x = 0, max_y = 0;
+	int min_x = maskImg.cols, min_y = maskImg.rows, max_x = -1, max_y = -1;
 	for (int i = 0; i < maskImg.rows; i++)
 	{
 		uchar* ptr = maskImg.ptr<uchar>(i);
@@ -606,18 +828,12 @@ void LabelingTaskControl::updateOutPutImg(QRect boundingRect, QImage& mask)
 		
 	}
 	
-	cv::Rect r;
-	if (min_x >= max_x || min_y >= max_y)
+	if (max_x >= min_x && max_y >= min_y)
 	{
-		r = cv::Rect();
+		cv::Rect r(cv::Point(roi.x + min_x, roi.y + min_y), cv::Point(roi.x + max_x + 1, roi.y + max_y + 1));
+		renderOutPutImg(r);
+		updateAllSurfaces(r);
 	}
-	else
-  { 
-    r = cv::Rect(cv::Point(min_x, min_y), cv::Point(max_x + 1, max_y + 1));
-    updateAllSurfaces(r);
-  }
-	//qDebug() << outPutImg.cols << ',' << outPutImg.rows;
-	//qDebug() <<"Rect:"<< r.x << ',' << r.y << ';' << r.width << ',' << r.height;
 	//updateSurface(_surfaceOutPut, r);
 }
 
@@ -654,7 +870,8 @@ void LabelingTaskControl::clearResult()
 #ifdef CHECK_QIMAGE
 		qt_debug::showQImage(_outPutImg);
 #endif
-		_outPutImg.fill(0);
+		_classImg.setTo(UNLABELED_CLASS);
+		renderOutPutImg();
 		_painterPathImage.fill(0);
 		_labelImg.setTo(0);
 		_surfaceOutPut->setOriginalImage(_outPutImg);
@@ -667,11 +884,62 @@ void LabelingTaskControl::clearResult()
 
 void LabelingTaskControl::loadResultFromDir()
 {
+	/*the index image is exact, the coloured one is mapped back through the label colours.
+	Indices are positions in the label list, so they are only trusted while the current label
+	colours still render them as the coloured result; otherwise the labels changed since saving*/
 	QString filePath = getResultSavingPathName();
 	cv::Mat IMG = cv::imread(filePath.toStdString());
-	QImage qIMG = ImageConversion::cvMat_to_QImage(IMG, true, true);
-	//copyQImageToQImage(qIMG, _outPutImg, false);
-	this->_outPutImg = qIMG;
+	if (!IMG.empty() && IMG.size() != _classImg.size()) IMG.release();
+	cv::Mat rgb;
+	if (!IMG.empty()) cv::cvtColor(IMG, rgb, CV_BGR2RGB);
+	cv::Mat idx = cv::imread(getIndexIMGSavingPathName().toStdString(), cv::IMREAD_UNCHANGED);
+	if (idx.empty() || idx.type() != CV_8U || idx.size() != _classImg.size())
+		idx.release();
+	else if (!rgb.empty() && !indexPlaneMatches(idx, rgb))
+	{
+		qDebug() << "Class indices do not match the labels any more, rebuilt from: " << filePath;
+		idx.release();
+	}
+	if (!idx.empty())
+	{
+		//classes are taken back through their colour, e.g. a black label saved as class 1 is unlabeled
+		Mat lut(1, 256, CV_8U);
+		for (int c = 0; c < 256; c++) lut.at<uchar>(c) = getClassIndexByKey(rgbKey(_colorOfClass[c]));
+		cv::LUT(idx, lut, _classImg);
+	}
+	else if (!rgb.empty())
+	{
+		rebuildClassImg(rgb);
+	}
+	else
+	{
+		qDebug() << "Result cannot be loaded: " << filePath;
+		return;
+	}
+	renderOutPutImg();
+}
+
+bool LabelingTaskControl::indexPlaneMatches(const Mat& idx, const Mat& rgb)
+{
+	/*lossless results hold exactly the colours they were rendered with, lossy ones only close to them*/
+	QString ext = QString::fromStdString(_pCtrl->get_imgExtension()).toLower();
+	bool lossy = ext == "jpg" || ext == "jpeg" || ext == "jp2" || ext == "webp";
+	int tolerance = lossy ? 48 : 0;
+	int64 allowed = lossy ? (int64)idx.total() / 20 : 0;
+	int64 wrong = 0;
+	for (int y = 0; y < idx.rows && wrong <= allowed; y++)
+	{
+		const uchar* c = idx.ptr<uchar>(y);
+		const Vec3b* p = rgb.ptr<Vec3b>(y);
+		for (int x = 0; x < idx.cols; x++)
+		{
+			const Vec3b& clr = _colorOfClass[c[x]];
+			if (std::abs(clr[0] - p[x][0]) > tolerance || std::abs(clr[1] - p[x][1]) > tolerance ||
+				std::abs(clr[2] - p[x][2]) > tolerance)
+				wrong++;
+		}
+	}
+	return wrong <= allowed;
 }
 
 void LabelingTaskControl::setAutoLoadResult(bool b)
@@ -690,6 +958,51 @@ void LabelingTaskControl::setAutoLoadResult(bool b)
 	qDebug() << QString("setAutoLoadResult:%1").arg(b);
 }
 
+Mat LabelingTaskControl::createMotionFrame(const Mat& frame, double& scale)
+{
+	scale = qMin<double>(1.0, double(TEMPORAL_MOTION_SIZE) / qMax(frame.cols, frame.rows));
+	Mat gray, small, result;
+	cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+	cv::resize(gray, small, cv::Size(), scale, scale, cv::INTER_AREA);
+	small.convertTo(result, CV_32F);
+	return result;
+}
+
+void LabelingTaskControl::temporalWarmStart(ProcessControl* pCtrl, Mat motionFrame, double scale, vector<SegmentationControl*> controls, QFuture<void> previous)
+{
+	previous.waitForFinished();
+	vector<PtrSlicSeeds> seeds = pCtrl->get_temporal_seeds();
+	Mat previousFrame = pCtrl->get_temporal_frame();
+	cv::Point2d shift(0, 0);
+	bool warm = seeds.size() == controls.size() && previousFrame.size() == motionFrame.size();
+	if (warm)
+	{
+		Mat window;
+		cv::createHanningWindow(window, motionFrame.size(), CV_32F);
+		double response = 0;
+		shift = cv::phaseCorrelate(previousFrame, motionFrame, window, &response);
+		shift *= 1.0 / scale;
+		qDebug() << "temporal superpixels, global shift:" << shift.x << shift.y << "response:" << response;
+		warm = response >= TEMPORAL_MIN_RESPONSE;
+	}
+	for (size_t i = 0; i < controls.size(); i++)
+	{
+		controls[i]->setWarmStartSeeds(warm ? seeds[i] : PtrSlicSeeds(), shift.x, shift.y);
+	}
+}
+
+void LabelingTaskControl::storeTemporalSeeds()
+{
+	if (!_pCtrl->get_superpixel_temporal() || _motionFrame.empty()) return;
+	vector<PtrSlicSeeds> seeds;
+	for (size_t i = 0; i < _segmentation_controls.size(); i++)
+	{
+		seeds.push_back(_segmentation_controls[i]->getSlicSeeds());
+	}
+	_pCtrl->set_temporal_seeds(seeds);
+	_pCtrl->set_temporal_frame(_motionFrame);
+}
+
 void LabelingTaskControl::resetSurfaceSource(Surface* surface, QImage* source)
 {
 	surface->setOriginalImage(*source);
@@ -733,41 +1046,31 @@ cv::Rect LabelingTaskControl::getBoundingRectOfVecPts(vector<cv::Point>& vecPts)
 	return cv::Rect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
 }
 
-void LabelingTaskControl::retrieveSegmentsDraw(vector<PtrSegmentPoints>*vecPts, QColor color)
+void LabelingTaskControl::retrieveSegmentsDraw(const SegmentIndex* index, vector<int>* segmentIds, QColor color)
 {
-	Mat outPutImg = ImageConversion::QImage_to_cvMat(_outPutImg, false);
-	int min_x = outPutImg.cols, min_y = outPutImg.rows, max_x = 0, max_y = 0;
-	for (size_t i = 0; i < vecPts->size(); i++)
+	const uchar cls = getClassIndexByColor(color);
+	const uchar canvas = getCanvasClass();
+	const bool onCanvas = _canvas_idx > 0;
+	const int numSegments = int(segmentIds->size());
+	int area = 0;
+	for (int i = 0; i < numSegments; i++) area += index->count((*segmentIds)[i]);
+	/*whole runs at a time, only pixels of the canvas class are painted on a canvas.
+	Segments share no pixels, so large fills are split over threads by segment*/
+#pragma omp parallel for schedule(dynamic, 16) if(area >= PARALLEL_FILL_PIXELS)
+	for (int i = 0; i < numSegments; i++)
 	{
-		PtrSegmentPoints pSegPts = (*vecPts)[i];
-		for (size_t j = 0; j < pSegPts->size(); j++)
+		int segment = (*segmentIds)[i];
+		for (const SegmentRun* run = index->runsBegin(segment); run != index->runsEnd(segment); ++run)
 		{
-			Point pt = (*pSegPts)[j];
-			if (min_x > pt.x) min_x = pt.x;
-			if (min_y > pt.y) min_y = pt.y;
-			if (max_x < pt.x) max_x = pt.x;
-			if (max_y < pt.y) max_y = pt.y;
-      if (_canvas_idx > 0)
-      {
-        if (outPutImg.at<cv::Vec3b>(pt.y, pt.x) == this->_canvasColor)
-        {
-          outPutImg.at<cv::Vec3b>(pt.y, pt.x) = Vec3b(color.red(), color.green(), color.blue());
-        }
-      }
-      else
-      {
-        outPutImg.at<cv::Vec3b>(pt.y, pt.x) = Vec3b(color.red(), color.green(), color.blue());
-      }
+			uchar* c = _classImg.ptr<uchar>(run->y) + run->x;
+			if (onCanvas)
+				fillRunOnCanvas(c, run->length, canvas, cls);
+			else
+				memset(c, cls, run->length);
 		}
 	}
-	cv::Rect r;
-	if (min_x >= max_x || min_y >= max_y)
-	{
-		r = cv::Rect();
-	}
-	else
-		r = cv::Rect(cv::Point(min_x, min_y), cv::Point(max_x + 1, max_y + 1));
-	//updateSurface(_surfaceOutPut, r);
+	cv::Rect r = index->bbox(*segmentIds);
+	renderOutPutImg(r);
 	updateAllSurfaces(r);
 }
 
@@ -775,27 +1078,20 @@ void LabelingTaskControl::retrievePolygonDraw(vector<Point> vecPts,QColor clr)
 {
   if (vecPts.size() > 0)
   {
-    Mat outPutImg = ImageConversion::QImage_to_cvMat(_outPutImg, false);
     vector<vector<Point> > vecvecPts;
     vecvecPts.push_back(vecPts);
+    cv::Rect r = getBoundingRectOfVecPts(vecPts) & cv::Rect(0, 0, _classImg.cols, _classImg.rows);
+    if (r.empty()) return;
+    /*the polygon is rendered as a mask of its bounding rect*/
+    Mat mask = Mat::zeros(r.size(), CV_8U);
+    cv::drawContours(mask, vecvecPts, -1, cv::Scalar(255), -1, 8, cv::noArray(), INT_MAX, -r.tl());
     if (_canvas_idx > 0)
     {
-      Mat temp;
-      outPutImg.copyTo(temp);
-      cv::drawContours(temp, vecvecPts, -1, cv::Scalar(clr.red(), clr.green(), clr.blue()), -1);
-      Mat mask = this->getClrMask(_canvasColor, outPutImg);
-      temp.copyTo(outPutImg, mask);
-    }
-    else
-    {
-      cv::drawContours(outPutImg, vecvecPts, -1, cv::Scalar(clr.red(), clr.green(), clr.blue()), -1);
+      mask = mask&getCanvasMask(r);
     }
+    _classImg(r).setTo(getClassIndexByColor(clr), mask);
+    renderOutPutImg(r);
     
-		cv::Rect r = getBoundingRectOfVecPts(vecPts);
-		if (r.empty())
-		{
-			r = cv::Rect();
-		}
 		updateAllSurfaces(r);
 	}
 }
@@ -815,22 +1111,93 @@ cv::Vec3b LabelingTaskControl::getColorByCanvasIndex(int idx)
     return cv::Vec3b(0, 0, 0);
 }
 
-cv::Mat LabelingTaskControl::getClrMask(cv::Vec3b clr, Mat& Img)
+void LabelingTaskControl::setupClassLookup()
 {
-  static Mat mClr(Img.rows, Img.cols, Img.type());
-  mClr.setTo(clr);
-  vector<Mat> vec_clr;
-  vector<Mat> vec_img;
-  cv::split(Img, vec_img);
-  cv::split(mClr, vec_clr);
-  static Mat mask;
-  mask = Mat(vec_img[0] == vec_clr[0]);
-  for (int i = 1; i < vec_clr.size(); i++)
+  _classOfColor.clear();
+  _colorOfClass.assign(256, UNLABELED_COLOR);
+  LabelList lst = _selection->getLabelList();
+  //a label of the unlabeled colour cannot be told apart from unlabeled pixels
+  _classOfColor[rgbKey(UNLABELED_COLOR)] = UNLABELED_CLASS;
+  for (size_t i = 0; i < lst.size() && i < 255; i++)
   {
-    mask = mask&(Mat(vec_img[i] == vec_clr[i]));
+    Vec3b clr(std::get<1>(lst[i]), std::get<2>(lst[i]), std::get<3>(lst[i]));
+    int key = rgbKey(clr);
+    if (_classOfColor.count(key)) continue;//labels of one colour share the class of the first one
+    _colorOfClass[i + 1] = clr;
+    _classOfColor[key] = (uchar)(i + 1);
   }
+}
 
-  return mask;
+uchar LabelingTaskControl::getClassIndexByColor(const QColor& clr)
+{
+  return getClassIndexByKey((clr.red() << 16) | (clr.green() << 8) | clr.blue());
+}
+
+uchar LabelingTaskControl::getClassIndexByKey(int key)
+{
+  std::map<int, uchar>::const_iterator it = _classOfColor.find(key);
+  return it == _classOfColor.end() ? UNLABELED_CLASS : it->second;
+}
+
+int LabelingTaskControl::rgbKey(const cv::Vec3b& clr)
+{
+  return (clr[0] << 16) | (clr[1] << 8) | clr[2];
+}
+
+void LabelingTaskControl::rebuildClassImg(const Mat& rgb)
+{
+  assert(rgb.type() == CV_8UC3);
+  _classImg.create(rgb.rows, rgb.cols, CV_8U);
+  for (int y = 0; y < rgb.rows; y++)
+  {
+    const Vec3b* p = rgb.ptr<Vec3b>(y);
+    uchar* c = _classImg.ptr<uchar>(y);
+    /*results are mostly long runs of one colour*/
+    int lastRgb = -1;
+    uchar lastCls = UNLABELED_CLASS;
+    for (int x = 0; x < rgb.cols; x++)
+    {
+      int key = rgbKey(p[x]);
+      if (key != lastRgb)
+      {
+        lastCls = getClassIndexByKey(key);
+        lastRgb = key;
+      }
+      c[x] = lastCls;
+    }
+  }
+}
+
+void LabelingTaskControl::renderOutPutImg(cv::Rect r)
+{
+  if (_outPutImg.width() != _classImg.cols || _outPutImg.height() != _classImg.rows)
+  {
+    _outPutImg = QImage(_classImg.cols, _classImg.rows, QImage::Format::Format_RGB888);
+    r = cv::Rect();
+  }
+  Mat outPutImg = ImageConversion::QImage_to_cvMat(_outPutImg, false);
+  cv::Rect full(0, 0, _classImg.cols, _classImg.rows);
+  r = r.area() > 0 ? r & full : full;
+#pragma omp parallel for if(r.area() >= PARALLEL_FILL_PIXELS)
+  for (int y = r.y; y < r.y + r.height; y++)
+  {
+    const uchar* c = _classImg.ptr<uchar>(y) + r.x;
+    Vec3b* p = outPutImg.ptr<Vec3b>(y) + r.x;
+    for (int x = 0; x < r.width; x++)
+    {
+      p[x] = _colorOfClass[c[x]];
+    }
+  }
+}
+
+uchar LabelingTaskControl::getCanvasClass()
+{
+  return getClassIndexByColor(QColor(_canvasColor[0], _canvasColor[1], _canvasColor[2]));
+}
+
+cv::Mat LabelingTaskControl::getCanvasMask(const cv::Rect& roi)
+{
+  return _classImg(roi) == getCanvasClass();
 }
 
 cv::Mat LabelingTaskControl::getDiffClrMask(cv::Vec3b clr,Mat& Img)
@@ -12,6 +12,10 @@
 #include <ProcessControl.h>
 #include <SegmentationControl.h>
 #include <vector>
+#include <deque>
+#include <map>
+#include <QFutureWatcher>
+#include <QProgressBar>
 using cv::Mat;
 using std::vector;
 using std::shared_ptr;
@@ -30,7 +34,17 @@ private:
 	void doSegmentation();//TODO
 
   cv::Vec3b getColorByCanvasIndex(int idx);
-  cv::Mat getClrMask(cv::Vec3b clr,Mat& Img);
+  /*class index plane: the labeling result, one byte per pixel, 0 for unlabeled, i+1 for the i-th label.
+  _outPutImg is only its coloured view, rendered for the rects that changed*/
+  void setupClassLookup();
+  uchar getClassIndexByColor(const QColor& clr);
+  uchar getClassIndexByKey(int key);//key 0xRRGGBB, unknown colours are unlabeled
+  static int rgbKey(const cv::Vec3b& clr);
+  void rebuildClassImg(const Mat& rgb);//class plane of a coloured result, unknown colours are unlabeled
+  bool indexPlaneMatches(const Mat& idx, const Mat& rgb);//saved class indices still render as the saved colours
+  void renderOutPutImg(cv::Rect r = cv::Rect());//colours of the class plane into _outPutImg, whole image by default
+  uchar getCanvasClass();//class of the canvas colour, labels of one colour are one class
+  cv::Mat getCanvasMask(const cv::Rect& roi);//pixels of roi holding the canvas class
   cv::Mat getDiffClrMask(cv::Vec3b clr,Mat& Img);
 	cv::Rect getBoundingRectOfVecPts(vector<cv::Point>& vecPts);
 	void setupColorSelectionConnections();//set quick access to color selection panel
@@ -55,9 +69,27 @@ private:
 	bool checkModified();
 	QString getResultSavingPathName();
 	QString getOriginalIMGSavingPathName();
+	QString getIndexIMGSavingPathName();
 	void releaseAll();
 	void setupOtherImg();
 	void resetSurfaceSource(Surface* surface,QImage* source);
+	/*temporal superpixels*/
+	Mat createMotionFrame(const Mat& frame, double& scale);
+	/*first job of a temporal segmentation: waits for the seeds of the previous frame (previous is the job
+	still storing them, if any) and starts SLIC of every control from them*/
+	static void temporalWarmStart(ProcessControl* pCtrl, Mat motionFrame, double scale, vector<SegmentationControl*> controls, QFuture<void> previous);
+	void storeTemporalSeeds();
+	/*superpixels of all levels are segmented without blocking, each level is usable once ready*/
+	void startSegmentation();
+	void startSegmentationJobs();//after the temporal warm start, if any
+	void watchSegmentation(const QFuture<void>& future, const vector<int>& levels);
+	void startNextLevel();//next of _pendingLevels, in the background unless it is the requested level
+	void showSegmentationLevel(int level);
+	void storeSegmentation();//all levels are ready: temporal seeds for the next frame, label images for the disk cache
+	/*for a frame left before it was segmented: waits for the running segmentations, stores the frame
+	as storeSegmentation does unless frameIdx is -1 (the frame stays incomplete) and deletes controls*/
+	static void finishSegmentation(vector<QFuture<void> > running, vector<SegmentationControl*> controls, int frameIdx,
+		ProcessControl* pCtrl, Mat motionFrame);
 protected:
 
 public:
@@ -65,7 +97,7 @@ signals:
 	void signalChangeLevelByDiff(int diff);
 public slots:
 	void retrievePainterPath(int PenWidth, QPainterPath& paintPath);
-	void retrieveSegmentsDraw(vector<PtrSegmentPoints>*vecPts, QColor color);
+	void retrieveSegmentsDraw(const SegmentIndex* index, vector<int>* segmentIds, QColor color);
 	void retrievePolygonDraw(vector<Point> vecPts, QColor clr);
 	void saveLabelResult();//save directory is set by constructor
 	void openSaveDir();//open the directory that will be used to hold saving files
@@ -74,6 +106,8 @@ public slots:
 	void changeTransparency(int value);
   void slotSetCanvasIndex(int index);
 	void setupSegmentationSurface(int level=0);
+private slots:
+	void slotSegmentationFinished();
 
 private:
 	/*Internal Images*/
@@ -106,6 +140,17 @@ private:
 	bool _segSurfaceSet;
   int _canvas_idx;
   cv::Vec3b _canvasColor;
+  Mat _classImg;//CV_8U, what every paint operation writes
+  std::map<int, uchar> _classOfColor;//0xRRGGBB -> class index
+  vector<cv::Vec3b> _colorOfClass;//class index -> RGB, 256 entries
   ProcessControl* _pCtrl;
+  Mat _motionFrame;//small gray copy of the frame, handed to ProcessControl with the seeds
+  double _motionScale;//of _motionFrame to the frame
+  vector<bool> _levelReady;//empty until segmentation is started
+  int _requestedLevel;//level to show, possibly not ready yet
+  vector<QFutureWatcher<void>*> _segWatchers;
+  vector<vector<int> > _segWatcherLevels;//levels finished with each watcher
+  std::deque<int> _pendingLevels;//levels not started yet, in the order they will run
+  QProgressBar* _segProgress;
 };
 
@@ -0,0 +1,187 @@
+#include "MeanShiftSegmenter.h"
+#include <algorithm>
+#include <cstdlib>
+#include "ThreadPriority.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+	/*passes over the pixel edges joining regions under the minimum size*/
+	const int SMALL_REGION_PASSES = 2;
+
+	int bandCount(int rows, int minRows, int threads)
+	{
+#ifdef _OPENMP
+		if (threads <= 0) threads = omp_get_max_threads();
+#else
+		threads = 1;
+#endif
+		return std::max(1, std::min(threads, rows / std::max(1, minRows)));
+	}
+
+	inline int colorDistance(const uchar* a, const uchar* b)
+	{
+		return std::abs(a[0] - b[0]) + std::abs(a[1] - b[1]) + std::abs(a[2] - b[2]);
+	}
+}
+
+MeanShiftSegmenter::MeanShiftSegmenter(int spatialRadius, double colorRadius, int minSize, int pyramidLevels, int colorMerge)
+{
+	if (spatialRadius <= 0 || colorRadius <= 0)
+		throw std::exception("mean shift radii must be positive");
+	_spatialRadius = spatialRadius;
+	_colorRadius = colorRadius;
+	_minSize = std::max(1, minSize);
+	_pyramidLevels = std::max(0, pyramidLevels);
+	_colorMerge = std::max(0, colorMerge);
+}
+
+MeanShiftSegmenter::~MeanShiftSegmenter()
+{
+}
+
+PtrSegmenter MeanShiftSegmenter::forPixelWidth(int pixelWidth)
+{
+	if (pixelWidth <= 0)
+		throw std::exception("mean shift pixel width cannot be smaller than 1");
+	int spatialRadius = std::max(2, pixelWidth / 3);
+	double colorRadius = 12 + pixelWidth / 2;
+	int minSize = pixelWidth*pixelWidth / 2;
+	return PtrSegmenter(new MeanShiftSegmenter(spatialRadius, colorRadius, minSize, 1));
+}
+
+int MeanShiftSegmenter::segment(const Mat& bgr, Mat& labels)
+{
+	assert(bgr.type() == CV_8UC3);
+	Mat filtered;
+	filter(bgr, filtered);
+	return labelRegions(filtered, labels);
+}
+
+void MeanShiftSegmenter::filter(const Mat& bgr, Mat& filtered)
+{
+	const int height = bgr.rows;
+	filtered.create(bgr.size(), CV_8UC3);
+	/*a band is filtered with a margin of the window size (at the coarsest level) around it,
+	so the pixels kept see the same neighbourhood as in a whole image run*/
+	const int margin = _spatialRadius << _pyramidLevels;
+	const int bands = bandCount(height, 4 * margin, _threads);
+	cv::TermCriteria criteria(cv::TermCriteria::MAX_ITER + cv::TermCriteria::EPS, 5, 1);
+#pragma omp parallel for schedule(static, 1) num_threads(bands)
+	for (int b = 0; b < bands; b++)
+	{
+		ScopedLowPriority priority(_lowPriority);//one band per thread
+		int y0 = height*b / bands;
+		int y1 = height*(b + 1) / bands;
+		int top = std::max(0, y0 - margin);
+		int bottom = std::min(height, y1 + margin);
+		Mat src = bgr.rowRange(top, bottom).clone();
+		Mat dst;
+		cv::pyrMeanShiftFiltering(src, dst, _spatialRadius, _colorRadius, _pyramidLevels, criteria);
+		dst.rowRange(y0 - top, y1 - top).copyTo(filtered.rowRange(y0, y1));
+	}
+}
+
+int MeanShiftSegmenter::find(int i)
+{
+	while (_parent[i] != i)
+	{
+		_parent[i] = _parent[_parent[i]];//path halving
+		i = _parent[i];
+	}
+	return i;
+}
+
+void MeanShiftSegmenter::unite(int a, int b)
+{
+	a = find(a);
+	b = find(b);
+	if (a == b) return;
+	/*the smaller index becomes the root, so the roots of a band stay in the band*/
+	if (a < b) _parent[b] = a;
+	else _parent[a] = b;
+}
+
+int MeanShiftSegmenter::labelRegions(const Mat& filtered, Mat& labels)
+{
+	assert(filtered.type() == CV_8UC3);
+	const int width = filtered.cols;
+	const int height = filtered.rows;
+	const int sz = width*height;
+	labels.create(height, width, CV_32S);
+	if (sz == 0) return 0;
+	_parent.resize(sz);
+	for (int i = 0; i < sz; i++) _parent[i] = i;
+
+	/*regions of similar colour, each band of rows on its own thread: the unions of a band
+	only touch its own pixels*/
+	const int bands = bandCount(height, 16, _threads);
+#pragma omp parallel for schedule(static, 1) num_threads(bands)
+	for (int b = 0; b < bands; b++)
+	{
+		ScopedLowPriority priority(_lowPriority);
+		int y0 = height*b / bands;
+		int y1 = height*(b + 1) / bands;
+		for (int y = y0; y < y1; y++)
+		{
+			const uchar* row = filtered.ptr<uchar>(y);
+			const uchar* up = y > y0 ? filtered.ptr<uchar>(y - 1) : NULL;
+			for (int x = 0; x < width; x++)
+			{
+				int i = y*width + x;
+				if (x > 0 && colorDistance(row + 3 * x, row + 3 * (x - 1)) <= _colorMerge) unite(i, i - 1);
+				if (up && colorDistance(row + 3 * x, up + 3 * x) <= _colorMerge) unite(i, i - width);
+			}
+		}
+	}
+	/*seams between the bands*/
+	for (int b = 1; b < bands; b++)
+	{
+		int y = height*b / bands;
+		const uchar* row = filtered.ptr<uchar>(y);
+		const uchar* up = filtered.ptr<uchar>(y - 1);
+		for (int x = 0; x < width; x++)
+		{
+			if (colorDistance(row + 3 * x, up + 3 * x) <= _colorMerge) unite(y*width + x, (y - 1)*width + x);
+		}
+	}
+
+	/*regions under the minimum size go to the neighbour across their first edge*/
+	_size.assign(sz, 0);
+	for (int i = 0; i < sz; i++) _size[find(i)]++;
+	for (int pass = 0; pass < SMALL_REGION_PASSES; pass++)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				int i = y*width + x;
+				for (int k = 0; k < 2; k++)
+				{
+					int j = k == 0 ? i + 1 : i + width;
+					if ((k == 0 && x + 1 >= width) || (k == 1 && y + 1 >= height)) continue;
+					int a = find(i);
+					int b = find(j);
+					if (a == b || (_size[a] >= _minSize && _size[b] >= _minSize)) continue;
+					unite(a, b);
+					_size[std::min(a, b)] = _size[a] + _size[b];
+				}
+			}
+		}
+	}
+
+	/*consecutive labels in scan order*/
+	vector<int>& labelOfRoot = _size;
+	std::fill(labelOfRoot.begin(), labelOfRoot.end(), -1);
+	int* plabels = (int*)labels.data;
+	int numLabels = 0;
+	for (int i = 0; i < sz; i++)
+	{
+		int root = find(i);
+		if (labelOfRoot[root] < 0) labelOfRoot[root] = numLabels++;
+		plabels[i] = labelOfRoot[root];
+	}
+	return numLabels;
+}
@@ -0,0 +1,37 @@
+/*Mean shift superpixels behind the Segmenter interface*/
+#pragma once
+#include <vector>
+#include "Segmenter.h"
+using std::vector;
+
+class MeanShiftSegmenter :public Segmenter
+{
+public:
+	/*
+	spatialRadius (pixels) and colorRadius (BGR units) are the mean shift window,
+	filtered on pyramidLevels coarser levels first (cv::pyrMeanShiftFiltering).
+	Neighbouring pixels whose filtered colours differ by at most colorMerge (sum of
+	the channel differences) form a region, regions smaller than minSize pixels are
+	joined to a neighbour.
+	*/
+	MeanShiftSegmenter(int spatialRadius, double colorRadius, int minSize, int pyramidLevels = 2, int colorMerge = 12);
+	virtual ~MeanShiftSegmenter();
+	/*parameters giving superpixels of roughly pixelWidth*pixelWidth pixels, like SLIC of that step*/
+	static PtrSegmenter forPixelWidth(int pixelWidth);
+public:
+	virtual int segment(const Mat& bgr, Mat& labels);
+	virtual const char* name() const { return "mean shift"; }
+	void filter(const Mat& bgr, Mat& filtered);//mean shift filtering in horizontal bands, one per thread
+	int labelRegions(const Mat& filtered, Mat& labels);//regions of filtered, small ones merged
+private:
+	int find(int i);
+	void unite(int a, int b);
+private:
+	int _spatialRadius;
+	double _colorRadius;
+	int _minSize;
+	int _pyramidLevels;
+	int _colorMerge;
+	vector<int> _parent;//union-find forest over the pixels
+	vector<int> _size;//pixels per root
+};
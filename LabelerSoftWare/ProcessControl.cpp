@@ -25,6 +25,21 @@ ProcessControl::ProcessControl(MetaData& meta, QObject* parent) :QObject(parent)
 	_skipFrameNum = meta.skipFrameNum;
 	_autoLoadResult = false;//Please keep this the same as in the video widget.
   _superpixel_scales = meta.superpixel_scales;
+  _superpixel_hierarchical = meta.superpixel_hierarchical;
+  _superpixel_temporal = meta.superpixel_temporal;
+  _superpixel_max_iterations = meta.superpixel_max_iterations;
+  _superpixel_tolerance = meta.superpixel_tolerance;
+  _superpixel_precompute_frames = meta.superpixel_precompute_frames;
+  _superpixel_disk_cache_enabled = meta.superpixel_disk_cache;
+  _superpixel_disk_cache_limit = meta.superpixel_disk_cache_limit;
+  _superpixel_boundary_thickness = meta.superpixel_boundary_thickness;
+  _superpixel_type = meta.superpixel_algorithm == "MeanShift" ? SegmentationControl::MEAN_SHIFT : SegmentationControl::SLIC_;
+  if (_superpixel_type != SegmentationControl::SLIC_ && (_superpixel_hierarchical || _superpixel_temporal))
+  {
+    qDebug() << "SuperPixelHierarchical and SuperPixelTemporal only apply to SLIC, ignored";
+    _superpixel_hierarchical = 0;
+    _superpixel_temporal = 0;
+  }
   //qDebug() << _superpixel_scales.size() << endl;
 }
 
@@ -38,6 +53,16 @@ ProcessControl::~ProcessControl()
 
 		_labelingTask->deleteLater(); _labelingTask = NULL; 
 	}
+	for (size_t i = 0; i < _segmentation_finishing.size(); i++) _segmentation_finishing[i].waitForFinished();
+}
+
+void ProcessControl::addSegmentationFinishing(const QFuture<void>& job)
+{
+	for (size_t i = _segmentation_finishing.size(); i-- > 0;)
+	{
+		if (_segmentation_finishing[i].isFinished()) _segmentation_finishing.erase(_segmentation_finishing.begin() + i);
+	}
+	_segmentation_finishing.push_back(job);
 }
 
 void ProcessControl::process()
@@ -147,6 +172,13 @@ void ProcessControl::processVideo()
 	QObject::connect(_w->getVideoWidget(), SIGNAL(signalClose()), this, SLOT(labelerSoftWareQuit()));
 	QObject::connect(_w->getVideoWidget(), SIGNAL(signalAutoLoadResult(bool)), this, SLOT(toggleAutoLoadResult(bool)));
 	QObject::connect(_w->getVideoWidget(), SIGNAL(signalUseSPSegs(int)), this, SLOT(useSPSegsLabeling(int)));
+	//temporal superpixels chain the seeds of consecutive frames, those are segmented on demand only and never cached
+	_superpixel_disk_cache.configure(QString(_outputDir.c_str()), QString(_filePath.c_str()), _superpixel_type, _superpixel_scales,
+		_superpixel_hierarchical != 0, _superpixel_max_iterations, _superpixel_tolerance, _superpixel_disk_cache_enabled != 0 && !_superpixel_temporal,
+		qint64(_superpixel_disk_cache_limit) << 20);
+	_superpixel_precompute.configure(QString(_filePath.c_str()), _superpixel_type, _superpixel_scales, _superpixel_hierarchical != 0,
+		_superpixel_max_iterations, _superpixel_tolerance, _superpixel_temporal ? 0 : _superpixel_precompute_frames, &_slic_arena,
+		&_superpixel_disk_cache);
 	_w->show();
 	
 }
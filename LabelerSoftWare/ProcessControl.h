@@ -7,6 +7,10 @@
 #include <videocontrol.h>
 #include <LabelingTaskControl.h>
 #include <DataType.h>
+#include <SegmentationControl.h>
+#include <SlicScratchArena.h>
+#include <SuperpixelDiskCache.h>
+#include <SuperpixelPrecompute.h>
 
 #define defGeter(name,type) \
 type get##name(){return this->name;}
@@ -59,6 +63,16 @@ public:
     defGeter(_skipFrameNum, int)
     defGeter(_autoLoadResult, bool)
     defGeter(_superpixel_scales,SuperpixelScales)
+    defGeter(_superpixel_hierarchical, int)
+    defGeter(_superpixel_temporal, int)
+    defGeter(_superpixel_max_iterations, int)
+    defGeter(_superpixel_tolerance, double)
+    defGeter(_superpixel_precompute_frames, int)
+    defGeter(_superpixel_disk_cache_enabled, int)
+    defGeter(_superpixel_disk_cache_limit, int)
+    defGeter(_superpixel_boundary_thickness, int)
+    defGeter(_temporal_seeds, vector<PtrSlicSeeds>)
+    defGeter(_temporal_frame, Mat)
 
     defSeter(_type, int)
     defSeter(_filePath, string)
@@ -72,6 +86,24 @@ public:
     defSeter(_skipFrameNum, int)
     defSeter(_autoLoadResult, bool)
     defSeter(_superpixel_scales,SuperpixelScales)
+    defSeter(_superpixel_hierarchical, int)
+    defSeter(_superpixel_temporal, int)
+    defSeter(_superpixel_max_iterations, int)
+    defSeter(_superpixel_tolerance, double)
+    defSeter(_superpixel_precompute_frames, int)
+    defSeter(_superpixel_disk_cache_enabled, int)
+    defSeter(_superpixel_disk_cache_limit, int)
+    defSeter(_superpixel_boundary_thickness, int)
+
+    SegmentationControl::segmentationType getSuperpixelType(){return _superpixel_type;}
+    SlicScratchArena* getSlicArena(){return &_slic_arena;}
+    SuperpixelPrecompute* getSuperpixelPrecompute(){return &_superpixel_precompute;}
+    SuperpixelDiskCache* getSuperpixelDiskCache(){return &_superpixel_disk_cache;}
+    defSeter(_temporal_seeds, vector<PtrSlicSeeds>)
+    defSeter(_temporal_frame, Mat)
+    /*jobs that finish the segmentation of frames left before it was done, the last one is the newest*/
+    void addSegmentationFinishing(const QFuture<void>& job);
+    QFuture<void> getSegmentationFinishing(){return _segmentation_finishing.empty() ? QFuture<void>() : _segmentation_finishing.back();}
 
 private:
 	int _type;
@@ -87,5 +119,20 @@ private:
 	int _skipFrameNum;//used to store parameter from metaData(xml file)
 	bool _autoLoadResult;
   vector<int> _superpixel_scales;
+  SegmentationControl::segmentationType _superpixel_type;//backend of the superpixel mode, SLIC_ or MEAN_SHIFT
+  int _superpixel_hierarchical;
+  int _superpixel_temporal;
+  int _superpixel_max_iterations;
+  double _superpixel_tolerance;
+  int _superpixel_precompute_frames;
+  int _superpixel_disk_cache_enabled;
+  int _superpixel_disk_cache_limit;//MB
+  int _superpixel_boundary_thickness;
+  vector<PtrSlicSeeds> _temporal_seeds;//converged SLIC seeds per scale of the last segmented frame
+  Mat _temporal_frame;//small gray copy of that frame, for the global motion estimate
+  vector<QFuture<void> > _segmentation_finishing;
+  SlicScratchArena _slic_arena;//SLIC buffers reused from frame to frame
+  SuperpixelDiskCache _superpixel_disk_cache;//label images of visited frames in the user cache directory
+  SuperpixelPrecompute _superpixel_precompute;//background SLIC of the next frames, declared after the arena and disk cache it uses
 };
 
@@ -72,6 +72,36 @@ bool ProcessSettingReader::parse()
     qDebug() << "scale input:"<< scales[idx] << endl;
   }
   _data.superpixel_scales = scales;
+  (*this)["SuperPixelAlgorithm"] >> _data.superpixel_algorithm;
+  if (_data.superpixel_algorithm.empty()) _data.superpixel_algorithm = "SLIC";
+  if (_data.superpixel_algorithm != "SLIC" && _data.superpixel_algorithm != "MeanShift")
+    throw std::exception("Please specify SLIC or MeanShift for <SuperPixelAlgorithm> tag");
+  qDebug() << "SuperPixelAlgorithm:" << _data.superpixel_algorithm.c_str();
+  //optional, 0 when the tag is missing
+  (*this)["SuperPixelHierarchical"] >> _data.superpixel_hierarchical;
+  qDebug() << "SuperPixelHierarchical:" << _data.superpixel_hierarchical;
+  (*this)["SuperPixelTemporal"] >> _data.superpixel_temporal;
+  qDebug() << "SuperPixelTemporal:" << _data.superpixel_temporal;
+  (*this)["SuperPixelMaxIterations"] >> _data.superpixel_max_iterations;
+  if (_data.superpixel_max_iterations <= 0) _data.superpixel_max_iterations = 10;
+  (*this)["SuperPixelTolerance"] >> _data.superpixel_tolerance;
+  if (_data.superpixel_tolerance < 0) throw std::exception("Please specify a non-negative number for <SuperPixelTolerance> tag");
+  qDebug() << "SuperPixelMaxIterations:" << _data.superpixel_max_iterations << "SuperPixelTolerance:" << _data.superpixel_tolerance;
+  (*this)["SuperPixelPrecomputeFrames"] >> _data.superpixel_precompute_frames;
+  if (_data.superpixel_precompute_frames < 0) throw std::exception("Please specify a non-negative number for <SuperPixelPrecomputeFrames> tag");
+  qDebug() << "SuperPixelPrecomputeFrames:" << _data.superpixel_precompute_frames;
+  (*this)["SuperPixelDiskCache"] >> _data.superpixel_disk_cache;
+  qDebug() << "SuperPixelDiskCache:" << _data.superpixel_disk_cache;
+  FileNode cacheLimitNode = (*this)["SuperPixelDiskCacheLimit"];
+  if (cacheLimitNode.empty()) _data.superpixel_disk_cache_limit = 2048;
+  else cacheLimitNode >> _data.superpixel_disk_cache_limit;
+  if (_data.superpixel_disk_cache_limit <= 0) throw std::exception("Please specify a positive number for <SuperPixelDiskCacheLimit> tag");
+  qDebug() << "SuperPixelDiskCacheLimit:" << _data.superpixel_disk_cache_limit;
+  FileNode thicknessNode = (*this)["SuperPixelBoundaryThickness"];
+  if (thicknessNode.empty()) _data.superpixel_boundary_thickness = 1;
+  else thicknessNode >> _data.superpixel_boundary_thickness;
+  if (_data.superpixel_boundary_thickness < 0) throw std::exception("Please specify a non-negative number for <SuperPixelBoundaryThickness> tag");
+  qDebug() << "SuperPixelBoundaryThickness:" << _data.superpixel_boundary_thickness;
 	return true;
 }
 
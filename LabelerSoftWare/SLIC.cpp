@@ -23,9 +23,25 @@
 
 #include <cfloat>
 #include <cmath>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include "SLIC.h"
+#include "ThreadPriority.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//SIMD path of the SLIC distance kernel. AVX is picked up when the project is
+//built with /arch:AVX or /arch:AVX2, SSE2 is always there on x64 builds.
+//Define SLIC_NO_SIMD to force the scalar kernel.
+#if !defined(SLIC_NO_SIMD) && defined(__AVX__)
+#define SLIC_SIMD_AVX
+#include <immintrin.h>
+#elif !defined(SLIC_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SLIC_SIMD_SSE2
+#include <emmintrin.h>
+#endif
 
 // For superpixels
 const int dx4[4] = {-1,  0,  1,  0};
@@ -38,6 +54,178 @@ const int dx10[10] = {-1,  0,  1,  0, -1,  1,  1, -1,  0, 0};
 const int dy10[10] = { 0, -1,  0,  1, -1, -1,  1,  1,  0, 0};
 const int dz10[10] = { 0,  0,  0,  0,  0,  0,  0,  0, -1, 1};
 
+//===========================================================================
+/// Lookup tables for the sRGB to CIELAB conversion
+///
+/// 8 bit sRGB linearization has only 256 possible results, so the three
+/// pow(x,2.4) calls of RGB2XYZ() become table reads. The CIELAB cube root
+/// f(t) = t^(1/3) is linearly interpolated from a 2048 entry table over
+/// [0, 1.0] (Xr, Yr and Zr normalised values never exceed that) and refined
+/// with one Newton step.
+///
+/// Tolerance: over all 2^24 sRGB colours the result differs from RGB2LAB()
+/// by less than 1e-6 in each of L, a and b (measured maximum 6.9e-7).
+//===========================================================================
+namespace
+{
+	const int		CBRT_TABLE_SIZE	= 2048;
+	const double	LAB_EPSILON		= 0.008856;	//actual CIE standard
+	const double	LAB_KAPPA		= 903.3;	//actual CIE standard
+
+	struct LabLookupTables
+	{
+		double linear[256];						//sRGB channel value -> linear RGB
+		double cbrt[CBRT_TABLE_SIZE + 2];		//cube root samples over [0, 1]
+
+		LabLookupTables()
+		{
+			for( int i = 0; i < 256; i++ )
+			{
+				double c = i/255.0;
+				if(c <= 0.04045)	linear[i] = c/12.92;
+				else				linear[i] = pow((c+0.055)/1.055,2.4);
+			}
+			for( int i = 0; i < CBRT_TABLE_SIZE + 2; i++ )
+			{
+				cbrt[i] = pow(double(i)/CBRT_TABLE_SIZE, 1.0/3.0);
+			}
+		}
+
+		//CIELAB f(t) for the normalised tristimulus value t
+		inline double f(double t) const
+		{
+			if(t <= LAB_EPSILON) return (LAB_KAPPA*t + 16.0)/116.0;
+
+			double pos = t*CBRT_TABLE_SIZE;
+			int idx = int(pos);
+			if(idx > CBRT_TABLE_SIZE) idx = CBRT_TABLE_SIZE;
+			double frac = pos - idx;
+			double y = cbrt[idx] + (cbrt[idx+1] - cbrt[idx])*frac;
+			return (2.0*y + t/(y*y))*(1.0/3.0);//one Newton step on y^3 = t
+		}
+	};
+
+	const LabLookupTables& GetLabLookupTables()
+	{
+		static const LabLookupTables tables;
+		return tables;
+	}
+
+	//===========================================================================
+	/// AssignRowToSeed
+	///
+	/// Distance kernel of the SLIC assignment step for the pixels [x1, x2) of
+	/// one image row against one seed. Stores the colour and spatial distances
+	/// of every visited pixel and takes the pixel over (distvec/klabels) when
+	/// the seed is closer. All lanes and the scalar tail evaluate the same
+	/// float expression, so the result does not depend on the SIMD width.
+	//===========================================================================
+	inline void AssignRowToSeed(
+		const float*				lrow,
+		const float*				arow,
+		const float*				brow,
+		float*						distlabrow,
+		float*						distxyrow,
+		float*						distvecrow,
+		int*						labelrow,
+		const int					x1,
+		const int					x2,
+		const float					dy2,//(y - seedy)^2 of this row
+		const float					sl,
+		const float					sa,
+		const float					sb,
+		const float					sx,
+		const float					invmaxlab,
+		const float					invxywt,
+		const int					n)
+	{
+		int x = x1;
+#if defined(SLIC_SIMD_AVX)
+		{
+			const __m256 vsl = _mm256_set1_ps(sl);
+			const __m256 vsa = _mm256_set1_ps(sa);
+			const __m256 vsb = _mm256_set1_ps(sb);
+			const __m256 vsx = _mm256_set1_ps(sx);
+			const __m256 vdy2 = _mm256_set1_ps(dy2);
+			const __m256 vinvmaxlab = _mm256_set1_ps(invmaxlab);
+			const __m256 vinvxywt = _mm256_set1_ps(invxywt);
+			const __m256 vstep = _mm256_set1_ps(8.0f);
+			const __m256 vn = _mm256_castsi256_ps(_mm256_set1_epi32(n));
+			__m256 vx = _mm256_setr_ps(float(x), float(x+1), float(x+2), float(x+3), float(x+4), float(x+5), float(x+6), float(x+7));
+			for( ; x + 8 <= x2; x += 8 )
+			{
+				__m256 dl = _mm256_sub_ps(_mm256_loadu_ps(lrow + x), vsl);
+				__m256 da = _mm256_sub_ps(_mm256_loadu_ps(arow + x), vsa);
+				__m256 db = _mm256_sub_ps(_mm256_loadu_ps(brow + x), vsb);
+				__m256 dlab = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dl, dl), _mm256_mul_ps(da, da)), _mm256_mul_ps(db, db));
+				__m256 dx = _mm256_sub_ps(vx, vsx);
+				__m256 dxy = _mm256_add_ps(_mm256_mul_ps(dx, dx), vdy2);
+				__m256 dist = _mm256_add_ps(_mm256_mul_ps(dlab, vinvmaxlab), _mm256_mul_ps(dxy, vinvxywt));
+				_mm256_storeu_ps(distlabrow + x, dlab);
+				_mm256_storeu_ps(distxyrow + x, dxy);
+
+				__m256 old = _mm256_loadu_ps(distvecrow + x);
+				__m256 closer = _mm256_cmp_ps(dist, old, _CMP_LT_OQ);
+				_mm256_storeu_ps(distvecrow + x, _mm256_blendv_ps(old, dist, closer));
+				__m256 oldlabel = _mm256_loadu_ps((const float*)(labelrow + x));
+				_mm256_storeu_ps((float*)(labelrow + x), _mm256_blendv_ps(oldlabel, vn, closer));
+				vx = _mm256_add_ps(vx, vstep);
+			}
+		}
+#elif defined(SLIC_SIMD_SSE2)
+		{
+			const __m128 vsl = _mm_set1_ps(sl);
+			const __m128 vsa = _mm_set1_ps(sa);
+			const __m128 vsb = _mm_set1_ps(sb);
+			const __m128 vsx = _mm_set1_ps(sx);
+			const __m128 vdy2 = _mm_set1_ps(dy2);
+			const __m128 vinvmaxlab = _mm_set1_ps(invmaxlab);
+			const __m128 vinvxywt = _mm_set1_ps(invxywt);
+			const __m128 vstep = _mm_set1_ps(4.0f);
+			const __m128i vn = _mm_set1_epi32(n);
+			__m128 vx = _mm_setr_ps(float(x), float(x+1), float(x+2), float(x+3));
+			for( ; x + 4 <= x2; x += 4 )
+			{
+				__m128 dl = _mm_sub_ps(_mm_loadu_ps(lrow + x), vsl);
+				__m128 da = _mm_sub_ps(_mm_loadu_ps(arow + x), vsa);
+				__m128 db = _mm_sub_ps(_mm_loadu_ps(brow + x), vsb);
+				__m128 dlab = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dl, dl), _mm_mul_ps(da, da)), _mm_mul_ps(db, db));
+				__m128 dx = _mm_sub_ps(vx, vsx);
+				__m128 dxy = _mm_add_ps(_mm_mul_ps(dx, dx), vdy2);
+				__m128 dist = _mm_add_ps(_mm_mul_ps(dlab, vinvmaxlab), _mm_mul_ps(dxy, vinvxywt));
+				_mm_storeu_ps(distlabrow + x, dlab);
+				_mm_storeu_ps(distxyrow + x, dxy);
+
+				__m128 old = _mm_loadu_ps(distvecrow + x);
+				__m128 closer = _mm_cmplt_ps(dist, old);
+				_mm_storeu_ps(distvecrow + x, _mm_min_ps(dist, old));
+				__m128i mask = _mm_castps_si128(closer);
+				__m128i oldlabel = _mm_loadu_si128((const __m128i*)(labelrow + x));
+				_mm_storeu_si128((__m128i*)(labelrow + x), _mm_or_si128(_mm_and_si128(mask, vn), _mm_andnot_si128(mask, oldlabel)));
+				vx = _mm_add_ps(vx, vstep);
+			}
+		}
+#endif
+		for( ; x < x2; x++ )
+		{
+			float dl = lrow[x] - sl;
+			float da = arow[x] - sa;
+			float db = brow[x] - sb;
+			float dlab = (dl*dl + da*da) + db*db;
+			float dx = float(x) - sx;
+			float dxy = dx*dx + dy2;
+			float dist = dlab*invmaxlab + dxy*invxywt;
+			distlabrow[x] = dlab;
+			distxyrow[x] = dxy;
+			if( dist < distvecrow[x] )
+			{
+				distvecrow[x] = dist;
+				labelrow[x] = n;
+			}
+		}
+	}
+}
+
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
@@ -51,15 +239,16 @@ SLIC::SLIC()
 	m_lvecvec = NULL;
 	m_avecvec = NULL;
 	m_bvecvec = NULL;
+
+	m_maxIterations = 10;
+	m_tolerance = 0;
+	m_threads = 0;
+	m_lowPriority = false;
+	m_scratch = &m_ownScratch;
 }
 
 SLIC::~SLIC()
 {
-	if(m_lvec) delete [] m_lvec;
-	if(m_avec) delete [] m_avec;
-	if(m_bvec) delete [] m_bvec;
-
-
 	if(m_lvecvec)
 	{
 		for( int d = 0; d < m_depth; d++ ) delete [] m_lvecvec[d];
@@ -146,6 +335,31 @@ void SLIC::RGB2LAB(const int& sR, const int& sG, const int& sB, double& lval, do
 	bval = 200.0*(fy-fz);
 }
 
+//===========================================================================
+///	RGB2LAB_LUT
+///
+/// Same conversion as RGB2LAB() using the lookup tables above.
+//===========================================================================
+void SLIC::RGB2LAB_LUT(const int& sR, const int& sG, const int& sB, double& lval, double& aval, double& bval)
+{
+	const LabLookupTables& lut = GetLabLookupTables();
+
+	double r = lut.linear[sR];
+	double g = lut.linear[sG];
+	double b = lut.linear[sB];
+
+	const double invXr = 1.0/0.950456;	//reference white
+	const double invZr = 1.0/1.088754;	//reference white
+
+	double fx = lut.f((r*0.4124564 + g*0.3575761 + b*0.1804375)*invXr);
+	double fy = lut.f( r*0.2126729 + g*0.7151522 + b*0.0721750);
+	double fz = lut.f((r*0.0193339 + g*0.1191920 + b*0.9503041)*invZr);
+
+	lval = 116.0*fy-16.0;
+	aval = 500.0*(fx-fy);
+	bval = 200.0*(fy-fz);
+}
+
 //===========================================================================
 ///	DoRGBtoLABConversion
 ///
@@ -153,14 +367,14 @@ void SLIC::RGB2LAB(const int& sR, const int& sG, const int& sB, double& lval, do
 //===========================================================================
 void SLIC::DoRGBtoLABConversion(
 	const unsigned int*&		ubuff,
-	double*&					lvec,
-	double*&					avec,
-	double*&					bvec)
+	vector<float>&				lvec,
+	vector<float>&				avec,
+	vector<float>&				bvec)
 {
 	int sz = m_width*m_height;
-	lvec = new double[sz];
-	avec = new double[sz];
-	bvec = new double[sz];
+	lvec.resize(sz);
+	avec.resize(sz);
+	bvec.resize(sz);
 
 	for( int j = 0; j < sz; j++ )
 	{
@@ -168,7 +382,11 @@ void SLIC::DoRGBtoLABConversion(
 		int g = (ubuff[j] >>  8) & 0xFF;
 		int b = (ubuff[j]      ) & 0xFF;
 
-		RGB2LAB( r, g, b, lvec[j], avec[j], bvec[j] );
+		double l, a, bb;
+		RGB2LAB_LUT( r, g, b, l, a, bb );
+		lvec[j] = float(l);
+		avec[j] = float(a);
+		bvec[j] = float(bb);
 	}
 }
 
@@ -192,11 +410,54 @@ void SLIC::DoRGBtoLABConversion(
 			int g = (ubuff[d][j] >>  8) & 0xFF;
 			int b = (ubuff[d][j]      ) & 0xFF;
 
-			RGB2LAB( r, g, b, lvec[d][j], avec[d][j], bvec[d][j] );
+			RGB2LAB_LUT( r, g, b, lvec[d][j], avec[d][j], bvec[d][j] );
 		}
 	}
 }
 
+//===========================================================================
+///	BenchmarkRGBtoLABConversion
+///
+/// Runs both conversions over the whole buffer; timings are in milliseconds.
+//===========================================================================
+void SLIC::BenchmarkRGBtoLABConversion(
+	const unsigned int*			ubuff,
+	const int					width,
+	const int					height,
+	double&						referenceMs,
+	double&						lookupMs,
+	double&						maxAbsDiff)
+{
+	int sz = width*height;
+	vector<double> lref(sz), aref(sz), bref(sz);
+	vector<double> llut(sz), alut(sz), blut(sz);
+
+	GetLabLookupTables();//build the tables outside of the timed section
+
+	chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+	for( int j = 0; j < sz; j++ )
+	{
+		RGB2LAB( (ubuff[j] >> 16) & 0xFF, (ubuff[j] >> 8) & 0xFF, ubuff[j] & 0xFF, lref[j], aref[j], bref[j] );
+	}
+	chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+	for( int j = 0; j < sz; j++ )
+	{
+		RGB2LAB_LUT( (ubuff[j] >> 16) & 0xFF, (ubuff[j] >> 8) & 0xFF, ubuff[j] & 0xFF, llut[j], alut[j], blut[j] );
+	}
+	chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+
+	referenceMs = chrono::duration<double, milli>(t1 - t0).count();
+	lookupMs = chrono::duration<double, milli>(t2 - t1).count();
+
+	maxAbsDiff = 0;
+	for( int j = 0; j < sz; j++ )
+	{
+		maxAbsDiff = max(maxAbsDiff, fabs(lref[j] - llut[j]));
+		maxAbsDiff = max(maxAbsDiff, fabs(aref[j] - alut[j]));
+		maxAbsDiff = max(maxAbsDiff, fabs(bref[j] - blut[j]));
+	}
+}
+
 //=================================================================================
 /// DrawContoursAroundSegments
 ///
@@ -326,32 +587,137 @@ void SLIC::DrawContoursAroundSegmentsTwoColors(
 	}
 }
 
+//===========================================================================
+///	ComputeBoundaryMask
+///
+/// A pixel is on a boundary when its label differs from the right or the
+/// lower neighbour, giving one pixel wide lines. Each row is compared with
+/// itself shifted by one and with the next row, 16 labels at a time.
+//===========================================================================
+void SLIC::ComputeBoundaryMask(
+	const int*				labels,
+	const int&				width,
+	const int&				height,
+	unsigned char*			mask)
+{
+	#pragma omp parallel for schedule(static)
+	for( int y = 0; y < height; y++ )
+	{
+		const int* row = labels + y*width;
+		const int* next = (y + 1 < height) ? row + width : row;//last row: only right neighbours differ
+		unsigned char* out = mask + y*width;
+		int x = 0;
+#if defined(SLIC_SIMD_AVX) || defined(SLIC_SIMD_SSE2)
+		const __m128i ones = _mm_set1_epi32(-1);
+		for( ; x + 17 <= width; x += 16 )
+		{
+			__m128i eq[4];
+			for( int q = 0; q < 4; q++ )
+			{
+				__m128i c = _mm_loadu_si128((const __m128i*)(row + x + 4*q));
+				__m128i r = _mm_loadu_si128((const __m128i*)(row + x + 4*q + 1));
+				__m128i d = _mm_loadu_si128((const __m128i*)(next + x + 4*q));
+				eq[q] = _mm_and_si128(_mm_cmpeq_epi32(c, r), _mm_cmpeq_epi32(c, d));
+			}
+			__m128i packed = _mm_packs_epi16(_mm_packs_epi32(eq[0], eq[1]), _mm_packs_epi32(eq[2], eq[3]));
+			_mm_storeu_si128((__m128i*)(out + x), _mm_xor_si128(packed, ones));
+		}
+#endif
+		for( ; x < width; x++ )
+		{
+			bool edge = (x + 1 < width && row[x] != row[x + 1]) || row[x] != next[x];
+			out[x] = edge ? 0xff : 0;
+		}
+	}
+}
+
+#ifdef OPENCV_SUPPORT
+//===========================================================================
+///	ComputeBoundaryMask
+//===========================================================================
+void SLIC::ComputeBoundaryMask(
+	const Mat&				labels,
+	Mat&					mask)
+{
+	assert(labels.type() == CV_32S && labels.isContinuous());
+	mask.create(labels.rows, labels.cols, CV_8U);
+	if( !mask.isContinuous() ) mask = Mat(labels.rows, labels.cols, CV_8U);
+	ComputeBoundaryMask((const int*)labels.data, labels.cols, labels.rows, mask.data);
+}
+
+//===========================================================================
+///	DrawBoundaryMask
+///
+/// Boundary pixels are painted 0xf0f0f0 and, when thickness > 0, the pixels
+/// within thickness of them 0x404040, as DrawContoursAroundSegmentsTwoColors
+/// does. The same mask can be drawn again at any thickness.
+//===========================================================================
+void SLIC::DrawBoundaryMask(
+	Mat&					bgr,
+	const Mat&				mask,
+	const int&				thickness)
+{
+	assert(bgr.type() == CV_8UC3 && mask.type() == CV_8U);
+	assert(bgr.rows == mask.rows && bgr.cols == mask.cols);
+	Mat halo;
+	if( thickness > 0 )
+		cv::dilate(mask, halo, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2*thickness + 1, 2*thickness + 1)));
+
+	#pragma omp parallel for schedule(static)
+	for( int y = 0; y < bgr.rows; y++ )
+	{
+		uchar* p = bgr.ptr<uchar>(y);
+		const uchar* core = mask.ptr<uchar>(y);
+		const uchar* around = thickness > 0 ? halo.ptr<uchar>(y) : core;
+		for( int x = 0; x < bgr.cols; x++, p += 3 )
+		{
+			if( core[x] ) p[0] = p[1] = p[2] = 0xf0;
+			else if( around[x] ) p[0] = p[1] = p[2] = 0x40;
+		}
+	}
+}
+
+//===========================================================================
+///	DrawContoursAroundSegmentsTwoColors
+///
+/// Mat version, built on the boundary mask.
+//===========================================================================
+void SLIC::DrawContoursAroundSegmentsTwoColors(
+	Mat&					bgr,
+	const Mat&				labels)
+{
+	Mat mask;
+	ComputeBoundaryMask(labels, mask);
+	DrawBoundaryMask(bgr, mask, 1);
+}
+#endif // OPENCV_SUPPORT
+
 
 //==============================================================================
 ///	DetectLabEdges
 //==============================================================================
 void SLIC::DetectLabEdges(
-	const double*				lvec,
-	const double*				avec,
-	const double*				bvec,
+	const float*				lvec,
+	const float*				avec,
+	const float*				bvec,
 	const int&					width,
 	const int&					height,
-	vector<double>&				edges)
+	vector<float>&				edges)
 {
 	int sz = width*height;
 
-	edges.resize(sz,0);
+	edges.assign(sz,0);
 	for( int j = 1; j < height-1; j++ )
 	{
 		for( int k = 1; k < width-1; k++ )
 		{
 			int i = j*width+k;
 
-			double dx = (lvec[i-1]-lvec[i+1])*(lvec[i-1]-lvec[i+1]) +
+			float dx = (lvec[i-1]-lvec[i+1])*(lvec[i-1]-lvec[i+1]) +
 						(avec[i-1]-avec[i+1])*(avec[i-1]-avec[i+1]) +
 						(bvec[i-1]-bvec[i+1])*(bvec[i-1]-bvec[i+1]);
 
-			double dy = (lvec[i-width]-lvec[i+width])*(lvec[i-width]-lvec[i+width]) +
+			float dy = (lvec[i-width]-lvec[i+width])*(lvec[i-width]-lvec[i+width]) +
 						(avec[i-width]-avec[i+width])*(avec[i-width]-avec[i+width]) +
 						(bvec[i-width]-bvec[i+width])*(bvec[i-width]-bvec[i+width]);
 
@@ -370,7 +736,7 @@ void SLIC::PerturbSeeds(
 	vector<double>&				kseedsb,
 	vector<double>&				kseedsx,
 	vector<double>&				kseedsy,
-	const vector<double>&		edges)
+	const vector<float>&		edges)
 {
 	const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
 	const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
@@ -423,7 +789,7 @@ void SLIC::GetLABXYSeeds_ForGivenStepSize(
 	vector<double>&				kseedsy,
 	const int&					STEP,
 	const bool&					perturbseeds,
-	const vector<double>&		edgemag)
+	const vector<float>&		edgemag)
 {
 	int numseeds(0);
 	int n(0);
@@ -474,6 +840,64 @@ void SLIC::GetLABXYSeeds_ForGivenStepSize(
 	}
 }
 
+//===========================================================================
+///	GetLABXYSeeds_FromPrevious
+///
+/// Seeds that stay inside the image keep their position (plus the global
+/// shift) and take the colour under them in the new frame. Every STEP x STEP
+/// cell without a seed then gets one at its centre, so that every pixel lies
+/// in the search window of at least one seed.
+//===========================================================================
+void SLIC::GetLABXYSeeds_FromPrevious(
+	vector<double>&				kseedsl,
+	vector<double>&				kseedsa,
+	vector<double>&				kseedsb,
+	vector<double>&				kseedsx,
+	vector<double>&				kseedsy,
+	const int&					STEP,
+	const SlicSeeds&			previous,
+	const double&				shiftx,
+	const double&				shifty)
+{
+	const int xcells = (m_width + STEP - 1)/STEP;
+	const int ycells = (m_height + STEP - 1)/STEP;
+	vector<char> occupied(xcells*ycells, 0);
+
+	kseedsl.resize(0); kseedsa.resize(0); kseedsb.resize(0); kseedsx.resize(0); kseedsy.resize(0);
+	for( size_t n = 0; n < previous.x.size(); n++ )
+	{
+		double x = previous.x[n] + shiftx;
+		double y = previous.y[n] + shifty;
+		if( x < 0 || y < 0 || x > m_width-1 || y > m_height-1 ) continue;//moved out of the frame
+		int cell = int(y)/STEP*xcells + int(x)/STEP;
+		if( occupied[cell] ) continue;//one seed per cell is enough, avoids piling up seeds
+		occupied[cell] = 1;
+		int xi = min(int(x+0.5), m_width-1);
+		int yi = min(int(y+0.5), m_height-1);
+		int i = yi*m_width + xi;
+		kseedsl.push_back(m_lvec[i]);
+		kseedsa.push_back(m_avec[i]);
+		kseedsb.push_back(m_bvec[i]);
+		kseedsx.push_back(x);
+		kseedsy.push_back(y);
+	}
+	for( int cy = 0; cy < ycells; cy++ )
+	{
+		for( int cx = 0; cx < xcells; cx++ )
+		{
+			if( occupied[cy*xcells + cx] ) continue;
+			int x = min(cx*STEP + STEP/2, m_width-1);
+			int y = min(cy*STEP + STEP/2, m_height-1);
+			int i = y*m_width + x;
+			kseedsl.push_back(m_lvec[i]);
+			kseedsa.push_back(m_avec[i]);
+			kseedsb.push_back(m_bvec[i]);
+			kseedsx.push_back(x);
+			kseedsy.push_back(y);
+		}
+	}
+}
+
 //===========================================================================
 ///	GetLABXYSeeds_ForGivenK
 ///
@@ -487,7 +911,7 @@ void SLIC::GetLABXYSeeds_ForGivenK(
 	vector<double>&				kseedsy,
 	const int&					K,
 	const bool&					perturbseeds,
-	const vector<double>&		edgemag)
+	const vector<float>&		edgemag)
 {
 	int sz = m_width*m_height;
 	double step = sqrt(double(sz)/double(K));
@@ -559,12 +983,14 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
 	vector<double>&				kseedsy,
 	int*						klabels,
 	const int&					STEP,
-	const int&					NUMITR)
+	const int&					NUMITR,
+	const double&				maxShift)
 {
 	int sz = m_width*m_height;
 	const int numk = kseedsl.size();
-	//double cumerr(99999.9);
+	double cumerr(99999.9);//mean centroid movement of the last iteration
 	int numitr(0);
+	m_iterationStats.clear();
 
 	//----------------
 	int offset = STEP;
@@ -578,94 +1004,178 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
 	vector<double> sigmay(numk, 0);
 	vector<int> clustersize(numk, 0);
 	vector<double> inv(numk, 0);//to store 1/clustersize[k] values
-	vector<double> distxy(sz, DBL_MAX);
-	vector<double> distlab(sz, DBL_MAX);
-	vector<double> distvec(sz, DBL_MAX);
-	vector<double> maxlab(numk, 10*10);//THIS IS THE VARIABLE VALUE OF M, just start with 10
-	vector<double> maxxy(numk, STEP*STEP);//THIS IS THE VARIABLE VALUE OF M, just start with 10
-
-	double invxywt = 1.0/(STEP*STEP);//NOTE: this is different from how usual SLIC/LKM works
+	vector<float>& distxy = m_scratch->distxy;
+	vector<float>& distlab = m_scratch->distlab;
+	vector<float>& distvec = m_scratch->distvec;
+	distxy.assign(sz, FLT_MAX);
+	distlab.assign(sz, FLT_MAX);
+	distvec.assign(sz, FLT_MAX);
+	vector<float> maxlab(numk, 10*10);//THIS IS THE VARIABLE VALUE OF M, just start with 10
+	vector<float> maxxy(numk, float(STEP*STEP));//THIS IS THE VARIABLE VALUE OF M, just start with 10
+
+	float invxywt = 1.0f/(STEP*STEP);//NOTE: this is different from how usual SLIC/LKM works
+
+	//-----------------------------------------------------------------
+	// Row bands. Each band owns the distvec/klabels writes of its rows
+	// and visits the seeds in ascending order like the serial loop, so
+	// the band count only changes the speed, never the labels.
+	//-----------------------------------------------------------------
+	int numbands = 1;
+	int numthreads = 1;
+#ifdef _OPENMP
+	numthreads = m_threads > 0 ? m_threads : omp_get_max_threads();
+	numbands = numthreads*2;
+#endif
+	numbands = max<int>(1, min<int>(numbands, m_height));
+	vector<int> bandstart(numbands + 1);
+	for( int t = 0; t <= numbands; t++ ) bandstart[t] = int((long long)m_height*t/numbands);
+
+	//-----------------------------------------------------------------
+	// Pixels of every cluster in raster order (counting sort of klabels),
+	// the centroid sums run over these lists so they are accumulated in
+	// exactly the same order as a plain raster scan.
+	//-----------------------------------------------------------------
+	vector<int>& bandcount = m_scratch->bandcount;
+	vector<int>& clusterstart = m_scratch->clusterstart;
+	vector<int>& clusterpixels = m_scratch->clusterpixels;
+	clusterstart.resize(numk + 1);
+	clusterpixels.resize(sz);
 
 	while( numitr < NUMITR )
 	{
 		//------
-		//cumerr = 0;
+		chrono::steady_clock::time_point itrstart = chrono::steady_clock::now();
 		numitr++;
 		//------
 
-		distvec.assign(sz, DBL_MAX);
-		for( int n = 0; n < numk; n++ )
+		distvec.assign(sz, FLT_MAX);
+#pragma omp parallel num_threads(numthreads)
 		{
-			int y1 = max<int>(0,			kseedsy[n]-offset);
-			int y2 = min<int>(m_height, kseedsy[n] + offset);
-			int x1 = max<int>(0, kseedsx[n] - offset);
-			int x2 = min<int>(m_width, kseedsx[n] + offset);
-
-			for( int y = y1; y < y2; y++ )
+			ScopedLowPriority priority(m_lowPriority);
+#pragma omp for schedule(dynamic, 1)
+			for( int t = 0; t < numbands; t++ )
 			{
-				for( int x = x1; x < x2; x++ )
+				const int bandy1 = bandstart[t];
+				const int bandy2 = bandstart[t + 1];
+				for( int n = 0; n < numk; n++ )
 				{
-					int i = y*m_width + x;
-					_ASSERT( y < m_height && x < m_width && y >= 0 && x >= 0 );
-
-					double l = m_lvec[i];
-					double a = m_avec[i];
-					double b = m_bvec[i];
-
-					distlab[i] =	(l - kseedsl[n])*(l - kseedsl[n]) +
-									(a - kseedsa[n])*(a - kseedsa[n]) +
-									(b - kseedsb[n])*(b - kseedsb[n]);
-
-					distxy[i] =		(x - kseedsx[n])*(x - kseedsx[n]) +
-									(y - kseedsy[n])*(y - kseedsy[n]);
-
+					int y1 = max<int>(0,			kseedsy[n]-offset);
+					int y2 = min<int>(m_height, kseedsy[n] + offset);
+					int x1 = max<int>(0, kseedsx[n] - offset);
+					int x2 = min<int>(m_width, kseedsx[n] + offset);
+
+					y1 = max<int>(y1, bandy1);
+					y2 = min<int>(y2, bandy2);
+					if( y1 >= y2 ) continue;
+
+					const float sl = float(kseedsl[n]);
+					const float sa = float(kseedsa[n]);
+					const float sb = float(kseedsb[n]);
+					const float sx = float(kseedsx[n]);
+					const float sy = float(kseedsy[n]);
 					//------------------------------------------------------------------------
-					double dist = distlab[i]/maxlab[n] + distxy[i]*invxywt;//only varying m, prettier superpixels
-					//double dist = distlab[i]/maxlab[n] + distxy[i]/maxxy[n];//varying both m and S
+					//only varying m, prettier superpixels
+					//(varying both m and S would weight distxy with 1/maxxy[n] instead)
 					//------------------------------------------------------------------------
-					
-					if( dist < distvec[i] )
+					const float invmaxlab = 1.0f/maxlab[n];
+
+					for( int y = y1; y < y2; y++ )
 					{
-						distvec[i] = dist;
-						klabels[i]  = n;
+						_ASSERT( y < m_height && y >= 0 && x1 >= 0 && x2 <= m_width );
+						const int row = y*m_width;
+						const float dy = float(y) - sy;
+
+						AssignRowToSeed(m_lvec + row, m_avec + row, m_bvec + row,
+							&distlab[row], &distxy[row], &distvec[row], klabels + row,
+							x1, x2, dy*dy, sl, sa, sb, sx, invmaxlab, invxywt, n);
 					}
 				}
 			}
 		}
 		//-----------------------------------------------------------------
-		// Assign the max color distance for a cluster
+		// Group the pixels by cluster: per band histograms, band-major
+		// prefix sum, then every band scatters its pixels in raster order.
 		//-----------------------------------------------------------------
-		if(0 == numitr)
+		bandcount.assign(numbands*numk, 0);
+#pragma omp parallel num_threads(numthreads)
 		{
-			maxlab.assign(numk,1);
-			maxxy.assign(numk,1);
+			ScopedLowPriority priority(m_lowPriority);
+#pragma omp for
+			for( int t = 0; t < numbands; t++ )
+			{
+				int* count = &bandcount[t*numk];
+				for( int i = bandstart[t]*m_width; i < bandstart[t + 1]*m_width; i++ )
+				{
+					_ASSERT(klabels[i] >= 0);
+					count[klabels[i]]++;
+				}
+			}
 		}
-		{for( int i = 0; i < sz; i++ )
 		{
-			if(maxlab[klabels[i]] < distlab[i]) maxlab[klabels[i]] = distlab[i];
-			if(maxxy[klabels[i]] < distxy[i]) maxxy[klabels[i]] = distxy[i];
-		}}
+			int total = 0;
+			for( int k = 0; k < numk; k++ )
+			{
+				clusterstart[k] = total;
+				for( int t = 0; t < numbands; t++ )
+				{
+					int c = bandcount[t*numk + k];
+					bandcount[t*numk + k] = total;
+					total += c;
+				}
+			}
+			clusterstart[numk] = total;
+		}
+#pragma omp parallel num_threads(numthreads)
+		{
+			ScopedLowPriority priority(m_lowPriority);
+#pragma omp for
+			for( int t = 0; t < numbands; t++ )
+			{
+				int* pos = &bandcount[t*numk];
+				for( int i = bandstart[t]*m_width; i < bandstart[t + 1]*m_width; i++ )
+				{
+					clusterpixels[pos[klabels[i]]++] = i;
+				}
+			}
+		}
 		//-----------------------------------------------------------------
-		// Recalculate the centroid and store in the seed values
+		// Assign the max color distance for a cluster and recalculate the
+		// centroid, each cluster is reduced independently over its pixels
 		//-----------------------------------------------------------------
-		sigmal.assign(numk, 0);
-		sigmaa.assign(numk, 0);
-		sigmab.assign(numk, 0);
-		sigmax.assign(numk, 0);
-		sigmay.assign(numk, 0);
-		clustersize.assign(numk, 0);
-
-		for( int j = 0; j < sz; j++ )
+		if(0 == numitr)
 		{
-			int temp = klabels[j];
-			_ASSERT(klabels[j] >= 0);
-			sigmal[klabels[j]] += m_lvec[j];
-			sigmaa[klabels[j]] += m_avec[j];
-			sigmab[klabels[j]] += m_bvec[j];
-			sigmax[klabels[j]] += (j%m_width);
-			sigmay[klabels[j]] += (j/m_width);
-
-			clustersize[klabels[j]]++;
+			maxlab.assign(numk,1);
+			maxxy.assign(numk,1);
+		}
+#pragma omp parallel num_threads(numthreads)
+		{
+			ScopedLowPriority priority(m_lowPriority);
+#pragma omp for schedule(dynamic, 64)
+			for( int k = 0; k < numk; k++ )
+			{
+				float mlab = maxlab[k];
+				float mxy = maxxy[k];
+				double suml(0), suma(0), sumb(0), sumx(0), sumy(0);
+				for( int p = clusterstart[k]; p < clusterstart[k + 1]; p++ )
+				{
+					int j = clusterpixels[p];
+					if(mlab < distlab[j]) mlab = distlab[j];
+					if(mxy < distxy[j]) mxy = distxy[j];
+					suml += m_lvec[j];
+					suma += m_avec[j];
+					sumb += m_bvec[j];
+					sumx += (j%m_width);
+					sumy += (j/m_width);
+				}
+				maxlab[k] = mlab;
+				maxxy[k] = mxy;
+				sigmal[k] = suml;
+				sigmaa[k] = suma;
+				sigmab[k] = sumb;
+				sigmax[k] = sumx;
+				sigmay[k] = sumy;
+				clustersize[k] = clusterstart[k + 1] - clusterstart[k];
+			}
 		}
 
 		{for( int k = 0; k < numk; k++ )
@@ -675,14 +1185,30 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
 			inv[k] = 1.0/double(clustersize[k]);//computing inverse now to multiply, than divide later
 		}}
 		
+		double summove(0);
+		int nummoved(0);
 		{for( int k = 0; k < numk; k++ )
 		{
+			double nx = sigmax[k]*inv[k];
+			double ny = sigmay[k]*inv[k];
+			if( clusterstart[k + 1] > clusterstart[k] )
+			{
+				summove += sqrt((nx - kseedsx[k])*(nx - kseedsx[k]) + (ny - kseedsy[k])*(ny - kseedsy[k]));
+				nummoved++;
+			}
 			kseedsl[k] = sigmal[k]*inv[k];
 			kseedsa[k] = sigmaa[k]*inv[k];
 			kseedsb[k] = sigmab[k]*inv[k];
-			kseedsx[k] = sigmax[k]*inv[k];
-			kseedsy[k] = sigmay[k]*inv[k];
+			kseedsx[k] = nx;
+			kseedsy[k] = ny;
 		}}
+		cumerr = nummoved > 0 ? summove/nummoved : 0;
+
+		SlicIterationStats stats;
+		stats.residual = cumerr;
+		stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - itrstart).count();
+		m_iterationStats.push_back(stats);
+		if( maxShift > 0 && cumerr < maxShift ) break;//converged
 	}
 }
 
@@ -721,103 +1247,260 @@ void SLIC::SaveSuperpixelLabels(
 ///		1. finding an adjacent label for each new component at the start
 ///		2. if a certain component is too small, assigning the previously found
 ///		    adjacent label to this component, and not incrementing the label.
+///
+/// Two-scan union-find version of the original flood fill, same output:
+/// the first scan gives every 4-connected run of equal labels a provisional
+/// id, merging ids of the left and upper neighbours (the smaller id wins, so
+/// a component's root is the id created at its first pixel in raster order).
+/// Components are then visited in that order, which is the order the flood
+/// fill started them in. The adjacent label is taken from the neighbours of
+/// the first pixel (left, up, right, down, last one wins) that belong to an
+/// earlier component, exactly the pixels the flood fill had labeled by then.
+/// labels is overwritten in place; the working buffers come from the
+/// SlicScratch of this object and are reused by the next call.
 //===========================================================================
 void SLIC::EnforceLabelConnectivity(
-	const int*					labels,//input labels that need to be corrected to remove stray labels
+	int*						labels,//input labels that need to be corrected to remove stray labels, new labels on return
 	const int&					width,
 	const int&					height,
-	int*						nlabels,//new labels
 	int&						numlabels,//the number of labels changes in the end if segments are removed
 	const int&					K) //the number of superpixels desired by the user
 {
-//	const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
-//	const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
-
 	const int dx4[4] = {-1,  0,  1,  0};
 	const int dy4[4] = { 0, -1,  0,  1};
 
 	const int sz = width*height;
 	const int SUPSZ = sz/K;
-	//nlabels.resize(sz, -1);
-	for( int i = 0; i < sz; i++ ) nlabels[i] = -1;
-	int label(0);
-	int* xvec = new int[sz];
-	int* yvec = new int[sz];
-	int oindex(0);
-	int adjlabel(0);//adjacent label
+
+	vector<int>& parent = m_scratch->cclParent;
+	vector<int>& first = m_scratch->cclFirst;
+	vector<int>& compsize = m_scratch->cclSize;
+	vector<int>& finallabel = m_scratch->cclFinal;
+	m_scratch->cclProvisional.resize(sz);
+	parent.resize(0);
+	first.resize(0);
+	int* prov = &m_scratch->cclProvisional[0];
+	//-------------------------------------------------------
+	// First scan: provisional ids, union with left and up
+	//-------------------------------------------------------
 	for( int j = 0; j < height; j++ )
 	{
 		for( int k = 0; k < width; k++ )
 		{
-			if( 0 > nlabels[oindex] )
+			const int i = j*width + k;
+			const int l = labels[i];
+			const bool left = k > 0 && labels[i-1] == l;
+			const bool up = j > 0 && labels[i-width] == l;
+			if( left && up )
 			{
-				nlabels[oindex] = label;
-				//--------------------
-				// Start a new segment
-				//--------------------
-				xvec[0] = k;
-				yvec[0] = j;
-				//-------------------------------------------------------
-				// Quickly find an adjacent label for use later if needed
-				//-------------------------------------------------------
-				{for( int n = 0; n < 4; n++ )
-				{
-					int x = xvec[0] + dx4[n];
-					int y = yvec[0] + dy4[n];
-					if( (x >= 0 && x < width) && (y >= 0 && y < height) )
-					{
-						int nindex = y*width + x;
-						if(nlabels[nindex] >= 0) adjlabel = nlabels[nindex];
-					}
-				}}
-
-				int count(1);
-				for( int c = 0; c < count; c++ )
-				{
-					for( int n = 0; n < 4; n++ )
-					{
-						int x = xvec[c] + dx4[n];
-						int y = yvec[c] + dy4[n];
-
-						if( (x >= 0 && x < width) && (y >= 0 && y < height) )
-						{
-							int nindex = y*width + x;
-
-							if( 0 > nlabels[nindex] && labels[oindex] == labels[nindex] )
-							{
-								xvec[count] = x;
-								yvec[count] = y;
-								nlabels[nindex] = label;
-								count++;
-							}
-						}
-
-					}
-				}
-				//-------------------------------------------------------
-				// If segment size is less then a limit, assign an
-				// adjacent label found before, and decrement label count.
-				//-------------------------------------------------------
-				if(count <= SUPSZ >> 2)
-				{
-					for( int c = 0; c < count; c++ )
-					{
-						int ind = yvec[c]*width+xvec[c];
-						nlabels[ind] = adjlabel;
-					}
-					label--;
-				}
-				label++;
+				int a = prov[i-1];
+				int b = prov[i-width];
+				while( parent[a] != a ) { parent[a] = parent[parent[a]]; a = parent[a]; }
+				while( parent[b] != b ) { parent[b] = parent[parent[b]]; b = parent[b]; }
+				if( a < b )		parent[b] = a;
+				else if( b < a )	parent[a] = b;
+				prov[i] = min(a, b);
+			}
+			else if( left )	prov[i] = prov[i-1];
+			else if( up )	prov[i] = prov[i-width];
+			else
+			{
+				prov[i] = int(parent.size());
+				parent.push_back(prov[i]);
+				first.push_back(i);
 			}
-			oindex++;
 		}
 	}
+	//-------------------------------------------------------
+	// Flatten to roots (parents always have smaller ids)
+	// and sum up the component sizes
+	//-------------------------------------------------------
+	const int numprov = int(parent.size());
+	compsize.assign(numprov, 0);
+	for( int i = 0; i < sz; i++ ) compsize[prov[i]]++;
+	for( int id = 0; id < numprov; id++ )
+	{
+		parent[id] = parent[parent[id]];
+		if( parent[id] != id ) compsize[parent[id]] += compsize[id];
+	}
+	//-------------------------------------------------------
+	// Final label of every component, in flood fill order
+	//-------------------------------------------------------
+	finallabel.resize(numprov);
+	int label(0);
+	int adjlabel(0);//adjacent label
+	for( int id = 0; id < numprov; id++ )
+	{
+		if( parent[id] != id ) continue;
+		const int x0 = first[id]%width;
+		const int y0 = first[id]/width;
+		{for( int n = 0; n < 4; n++ )
+		{
+			int x = x0 + dx4[n];
+			int y = y0 + dy4[n];
+			if( (x >= 0 && x < width) && (y >= 0 && y < height) )
+			{
+				int root = parent[prov[y*width + x]];
+				if( root < id ) adjlabel = finallabel[root];
+			}
+		}}
+		//-------------------------------------------------------
+		// If segment size is less then a limit, assign an
+		// adjacent label found before, and do not count it.
+		//-------------------------------------------------------
+		if( compsize[id] <= SUPSZ >> 2 )	finallabel[id] = adjlabel;
+		else								finallabel[id] = label++;
+	}
+	//-------------------------------------------------------
+	// Second scan: write the labels back
+	//-------------------------------------------------------
+	for( int i = 0; i < sz; i++ ) labels[i] = finallabel[parent[prov[i]]];
 	numlabels = label;
+}
+
+//===========================================================================
+///	SetScratch
+///
+/// Lets the run use working buffers that outlive this SLIC object. NULL
+/// switches back to the buffers owned by the object.
+//===========================================================================
+void SLIC::SetScratch(
+	SlicScratch*				scratch)
+{
+	m_scratch = scratch ? scratch : &m_ownScratch;
+}
+
+//===========================================================================
+///	SetIterationControl
+///
+/// maxIterations caps the k-means iterations (10 by default). A positive
+/// tolerance stops earlier once the centroids move by less than tolerance
+/// pixels on average; 0 always runs maxIterations.
+//===========================================================================
+void SLIC::SetIterationControl(
+	const int					maxIterations,
+	const double				tolerance)
+{
+	m_maxIterations = max(1, maxIterations);
+	m_tolerance = max(0.0, tolerance);
+}
+
+//===========================================================================
+///	SetThreading
+///
+/// threads is the size of the OpenMP teams of the k-means iterations, 0 for
+/// the OpenMP default. lowPriority runs their threads below normal priority,
+/// the threads of the team and not only the calling one.
+//===========================================================================
+void SLIC::SetThreading(
+	const int					threads,
+	const bool					lowPriority)
+{
+	m_threads = max(0, threads);
+	m_lowPriority = lowPriority;
+}
+
+const vector<SlicIterationStats>& SLIC::GetIterationStats() const
+{
+	return m_iterationStats;
+}
+
+//===========================================================================
+///	PrepareInputContext
+///
+/// Everything of a frame that does not depend on the superpixel size: the
+/// ARGB copy, the LAB planes and the edge magnitudes for PerturbSeeds().
+//===========================================================================
+void SLIC::PrepareInputContext(
+	const unsigned int*			ubuff,
+	const int					width,
+	const int					height,
+	SlicInputContext&			context)
+{
+	m_width  = width;
+	m_height = height;
+	int sz = m_width*m_height;
+	context.width = width;
+	context.height = height;
+	if( ubuff != context.argb.data() ) context.argb.assign(ubuff, ubuff + sz);
+	//--------------------------------------------------
+	if(1)//LAB
+	{
+		DoRGBtoLABConversion(ubuff, context.lvec, context.avec, context.bvec);
+	}
+	else//RGB
+	{
+		context.lvec.resize(sz); context.avec.resize(sz); context.bvec.resize(sz);
+		for( int i = 0; i < sz; i++ )
+		{
+			context.lvec[i] = ubuff[i] >> 16 & 0xff;
+			context.avec[i] = ubuff[i] >>  8 & 0xff;
+			context.bvec[i] = ubuff[i]       & 0xff;
+		}
+	}
+	//--------------------------------------------------
+	context.edges.clear();
+	DetectLabEdges(&context.lvec[0], &context.avec[0], &context.bvec[0], m_width, m_height, context.edges);
+}
 
-	if(xvec) delete [] xvec;
-	if(yvec) delete [] yvec;
+#ifdef OPENCV_SUPPORT
+//===========================================================================
+///	PrepareInputContext
+///
+/// Mat version: the LAB planes are filled straight from the BGR rows, so
+/// neither CopyMatToMem() nor the ARGB unpacking is needed.
+//===========================================================================
+void SLIC::PrepareInputContext(
+	const Mat&					bgr,
+	SlicInputContext&			context)
+{
+	assert(bgr.type() == CV_8UC3);
+	m_width  = bgr.cols;
+	m_height = bgr.rows;
+	int sz = m_width*m_height;
+	context.width = m_width;
+	context.height = m_height;
+	context.argb.clear();
+	context.lvec.resize(sz);
+	context.avec.resize(sz);
+	context.bvec.resize(sz);
+	for( int j = 0; j < m_height; j++ )
+	{
+		const uchar* p = bgr.ptr<uchar>(j);
+		const int row = j*m_width;
+		for( int k = 0; k < m_width; k++, p += 3 )
+		{
+			double l, a, b;
+			RGB2LAB_LUT( p[2], p[1], p[0], l, a, b );
+			context.lvec[row + k] = float(l);
+			context.avec[row + k] = float(a);
+			context.bvec[row + k] = float(b);
+		}
+	}
+	context.edges.clear();
+	DetectLabEdges(&context.lvec[0], &context.avec[0], &context.bvec[0], m_width, m_height, context.edges);
 }
 
+//===========================================================================
+///	PerformSLICO_ForGivenStepSize
+///
+/// Mat version, labels go straight into a CV_32S image.
+//===========================================================================
+void SLIC::PerformSLICO_ForGivenStepSize(
+	const Mat&					bgr,
+	Mat&						labels,
+	int&						numlabels,
+	const int&					STEP,
+	const double&				m)
+{
+	SlicInputContext context;
+	PrepareInputContext(bgr, context);
+	labels.create(bgr.rows, bgr.cols, CV_32S);
+	if( !labels.isContinuous() ) labels = Mat(bgr.rows, bgr.cols, CV_32S);//a caller ROI cannot be written as one buffer
+	PerformSLICO_ForGivenStepSize(context, (int*)labels.data, numlabels, STEP, m);
+}
+#endif // OPENCV_SUPPORT
+
 //===========================================================================
 ///	PerformSLICO_ForGivenStepSize
 ///
@@ -831,6 +1514,18 @@ void SLIC::PerformSLICO_ForGivenStepSize(
 	int&						numlabels,
 	const int&					STEP,
 	const double&				m)
+{
+	SlicInputContext context;
+	PrepareInputContext(ubuff, width, height, context);
+	PerformSLICO_ForGivenStepSize(context, klabels, numlabels, STEP, m);
+}
+
+void SLIC::PerformSLICO_ForGivenStepSize(
+	const SlicInputContext&		context,
+	int*						klabels,
+	int&						numlabels,
+	const int&					STEP,
+	const double&				m)
 {
 	vector<double> kseedsl(0);
 	vector<double> kseedsa(0);
@@ -839,29 +1534,73 @@ void SLIC::PerformSLICO_ForGivenStepSize(
 	vector<double> kseedsy(0);
 
 	//--------------------------------------------------
-	m_width  = width;
-	m_height = height;
+	m_width  = context.width;
+	m_height = context.height;
 	int sz = m_width*m_height;
 	//klabels.resize( sz, -1 );
 	//--------------------------------------------------
 	//klabels = new int[sz];
 	for( int s = 0; s < sz; s++ ) klabels[s] = -1;
 	//--------------------------------------------------
-	DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
+	m_lvec = &context.lvec[0];
+	m_avec = &context.avec[0];
+	m_bvec = &context.bvec[0];
 	//--------------------------------------------------
 
 	bool perturbseeds(true);
-	vector<double> edgemag(0);
-	if(perturbseeds) DetectLabEdges(m_lvec, m_avec, m_bvec, m_width, m_height, edgemag);
-	GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, perturbseeds, edgemag);
+	GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, perturbseeds, context.edges);
 
-	PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,10);
+	PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,m_maxIterations,m_tolerance);
 	numlabels = kseedsl.size();
 
-	int* nlabels = new int[sz];
-	EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, double(sz)/double(STEP*STEP));
-	{for(int i = 0; i < sz; i++ ) klabels[i] = nlabels[i];}
-	if(nlabels) delete [] nlabels;
+	EnforceLabelConnectivity(klabels, m_width, m_height, numlabels, double(sz)/double(STEP*STEP));
+	m_lvec = m_avec = m_bvec = NULL;
+}
+
+//===========================================================================
+///	PerformSLICO_WarmStart
+///
+/// Same as PerformSLICO_ForGivenStepSize(), but seeded from the previous
+/// frame and stopped on convergence instead of after 10 iterations.
+//===========================================================================
+void SLIC::PerformSLICO_WarmStart(
+	const SlicInputContext&		context,
+	int*						klabels,
+	int&						numlabels,
+	const int&					STEP,
+	SlicSeeds&					seeds,
+	const double&				shiftx,
+	const double&				shifty,
+	const double&				maxShift)
+{
+	//--------------------------------------------------
+	m_width  = context.width;
+	m_height = context.height;
+	int sz = m_width*m_height;
+	for( int s = 0; s < sz; s++ ) klabels[s] = -1;
+	//--------------------------------------------------
+	m_lvec = &context.lvec[0];
+	m_avec = &context.avec[0];
+	m_bvec = &context.bvec[0];
+	//--------------------------------------------------
+
+	SlicSeeds current;
+	bool warm = !seeds.x.empty();
+	if( warm )
+	{
+		GetLABXYSeeds_FromPrevious(current.l, current.a, current.b, current.x, current.y, STEP, seeds, shiftx, shifty);
+	}
+	else
+	{
+		GetLABXYSeeds_ForGivenStepSize(current.l, current.a, current.b, current.x, current.y, STEP, true, context.edges);
+	}
+
+	PerformSuperpixelSegmentation_VariableSandM(current.l,current.a,current.b,current.x,current.y,klabels,STEP,m_maxIterations,warm ? maxShift : m_tolerance);
+	numlabels = current.l.size();
+
+	EnforceLabelConnectivity(klabels, m_width, m_height, numlabels, double(sz)/double(STEP*STEP));
+	m_lvec = m_avec = m_bvec = NULL;
+	seeds = current;
 }
 
 //===========================================================================
@@ -877,6 +1616,18 @@ void SLIC::PerformSLICO_ForGivenK(
 	int&						numlabels,
 	const int&					K,//required number of superpixels
 	const double&				m)//weight given to spatial distance
+{
+	SlicInputContext context;
+	PrepareInputContext(ubuff, width, height, context);
+	PerformSLICO_ForGivenK(context, klabels, numlabels, K, m);
+}
+
+void SLIC::PerformSLICO_ForGivenK(
+	const SlicInputContext&		context,
+	int*						klabels,
+	int&						numlabels,
+	const int&					K,//required number of superpixels
+	const double&				m)//weight given to spatial distance
 {
 	vector<double> kseedsl(0);
 	vector<double> kseedsa(0);
@@ -885,43 +1636,28 @@ void SLIC::PerformSLICO_ForGivenK(
 	vector<double> kseedsy(0);
 
 	//--------------------------------------------------
-	m_width  = width;
-	m_height = height;
+	m_width  = context.width;
+	m_height = context.height;
 	int sz = m_width*m_height;
 	//--------------------------------------------------
 	//if(0 == klabels) klabels = new int[sz];
 	for( int s = 0; s < sz; s++ ) klabels[s] = -1;
 	//--------------------------------------------------
-	if(1)//LAB
-	{
-		DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
-	}
-	else//RGB
-	{
-		m_lvec = new double[sz]; m_avec = new double[sz]; m_bvec = new double[sz];
-		for( int i = 0; i < sz; i++ )
-		{
-			m_lvec[i] = ubuff[i] >> 16 & 0xff;
-			m_avec[i] = ubuff[i] >>  8 & 0xff;
-			m_bvec[i] = ubuff[i]       & 0xff;
-		}
-	}
+	m_lvec = &context.lvec[0];
+	m_avec = &context.avec[0];
+	m_bvec = &context.bvec[0];
 	//--------------------------------------------------
 
 	bool perturbseeds(true);
-	vector<double> edgemag(0);
-	if(perturbseeds) DetectLabEdges(m_lvec, m_avec, m_bvec, m_width, m_height, edgemag);
-	GetLABXYSeeds_ForGivenK(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, K, perturbseeds, edgemag);
+	GetLABXYSeeds_ForGivenK(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, K, perturbseeds, context.edges);
 
 	int STEP = sqrt(double(sz)/double(K)) + 2.0;//adding a small value in the even the STEP size is too small.
 	//PerformSuperpixelSLIC(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, klabels, STEP, edgemag, m);
-	PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,10);
+	PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,m_maxIterations,m_tolerance);
 	numlabels = kseedsl.size();
 
-	int* nlabels = new int[sz];
-	EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, K);
-	{for(int i = 0; i < sz; i++ ) klabels[i] = nlabels[i];}
-	if(nlabels) delete [] nlabels;
+	EnforceLabelConnectivity(klabels, m_width, m_height, numlabels, K);
+	m_lvec = m_avec = m_bvec = NULL;
 }
 
 #ifdef OPENCV_SUPPORT
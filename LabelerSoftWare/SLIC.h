@@ -40,6 +40,69 @@ namespace slic
 }
 #endif // OPENCV_SUPPORT
 
+//============================================================================
+// Per-frame SLIC input: the ARGB buffer, the single precision LAB planes and
+// the LAB edge map of one image. Built once by SLIC::PrepareInputContext()
+// and then only read, so every superpixel scale of a frame can share it.
+//============================================================================
+struct SlicInputContext
+{
+	int							width;
+	int							height;
+	vector<unsigned int>		argb;//ARGB copy of the input, only kept by the ARGB PrepareInputContext()
+	vector<float>				lvec;
+	vector<float>				avec;
+	vector<float>				bvec;
+	vector<float>				edges;
+
+	SlicInputContext() : width(0), height(0) {}
+};
+
+//============================================================================
+// Full image working buffers of a SLIC run. They only grow, so a scratch
+// reused for frames of the same size does no large allocation after the
+// first run. One scratch must not be used by two runs at the same time.
+//============================================================================
+struct SlicScratch
+{
+	int							width;
+	int							height;
+	vector<float>				distxy;
+	vector<float>				distlab;
+	vector<float>				distvec;
+	vector<int>					clusterpixels;//pixel indices grouped by cluster
+	vector<int>					clusterstart;
+	vector<int>					bandcount;
+	vector<int>					cclProvisional;//provisional component id per pixel
+	vector<int>					cclParent;//union-find parent per provisional id
+	vector<int>					cclFirst;//first pixel of every provisional id
+	vector<int>					cclSize;
+	vector<int>					cclFinal;//output label per root id
+
+	SlicScratch() : width(0), height(0) {}
+};
+
+//============================================================================
+// Residual (mean centroid movement in pixels) and duration of one iteration
+//============================================================================
+struct SlicIterationStats
+{
+	double						residual;
+	double						ms;
+};
+
+//============================================================================
+// Cluster centres of a finished SLIC run, kept to warm start the next frame
+//============================================================================
+struct SlicSeeds
+{
+	vector<double>				l;
+	vector<double>				a;
+	vector<double>				b;
+	vector<double>				x;
+	vector<double>				y;
+};
+
 class SLIC  
 {
 public:
@@ -68,6 +131,67 @@ public:
 		const int&					K,
 		const double&				m);
 
+	//============================================================================
+	// Convert an ARGB buffer into a shared SLIC input context (LAB + edges)
+	//============================================================================
+	void PrepareInputContext(
+		const unsigned int*			ubuff,//Each 32 bit unsigned int contains ARGB pixel values.
+		const int					width,
+		const int					height,
+		SlicInputContext&			context);
+#ifdef OPENCV_SUPPORT
+	//============================================================================
+	// Same, reading a (possibly strided) CV_8UC3 BGR image row by row. No ARGB
+	// copy is made, context.argb is left empty.
+	//============================================================================
+	void PrepareInputContext(
+		const Mat&					bgr,
+		SlicInputContext&			context);
+	//============================================================================
+	// Superpixel segmentation of a CV_8UC3 BGR image. labels is (re)allocated
+	// as a CV_32S image of the same size when it does not already have it.
+	//============================================================================
+	void PerformSLICO_ForGivenStepSize(
+		const Mat&					bgr,
+		Mat&						labels,
+		int&						numlabels,
+		const int&					STEP,
+		const double&				m);
+#endif // OPENCV_SUPPORT
+	//============================================================================
+	// Same as above, reading LAB planes and edges from a prepared context.
+	// The context is not modified and may be used by several threads at once.
+	//============================================================================
+	void PerformSLICO_ForGivenStepSize(
+		const SlicInputContext&		context,
+		int*						klabels,
+		int&						numlabels,
+		const int&					STEP,
+		const double&				m);
+	void PerformSLICO_ForGivenK(
+		const SlicInputContext&		context,
+		int*						klabels,
+		int&						numlabels,
+		const int&					K,
+		const double&				m);
+	//============================================================================
+	// Temporal mode for consecutive video frames. The seeds of the previous
+	// frame are moved by (shiftx, shifty), grid cells left without a seed get
+	// a fresh one, and iterations stop as soon as the centroids move by less
+	// than maxShift pixels on average. Empty seeds fall back to the regular
+	// grid and the SetIterationControl() tolerance. On return seeds holds
+	// the centres.
+	//============================================================================
+	void PerformSLICO_WarmStart(
+		const SlicInputContext&		context,
+		int*						klabels,
+		int&						numlabels,
+		const int&					STEP,
+		SlicSeeds&					seeds,
+		const double&				shiftx,
+		const double&				shifty,
+		const double&				maxShift);
+
 	//============================================================================
 	// Save superpixel labels in a text file in raster scan order
 	//============================================================================
@@ -93,12 +217,84 @@ public:
 		const int*					labels,
 		const int&					width,
 		const int&					height);
+	//============================================================================
+	// Boundary bitmask of a label image: 0xff where the label differs from the
+	// right or lower neighbour, 0 elsewhere. mask holds width*height bytes.
+	//============================================================================
+	void ComputeBoundaryMask(
+		const int*					labels,
+		const int&					width,
+		const int&					height,
+		unsigned char*				mask);
+#ifdef OPENCV_SUPPORT
+	//============================================================================
+	// Same for a CV_32S label image, mask is (re)allocated as CV_8U.
+	//============================================================================
+	void ComputeBoundaryMask(
+		const Mat&					labels,
+		Mat&						mask);
+	//============================================================================
+	// Paints a boundary mask into a CV_8UC3 image in the two contour colours,
+	// with a dark band of the given thickness around the light line.
+	//============================================================================
+	void DrawBoundaryMask(
+		Mat&						bgr,
+		const Mat&					mask,
+		const int&					thickness);
+	//============================================================================
+	// Two colour contours drawn straight into a CV_8UC3 image, labels is a
+	// CV_32S image of the same size.
+	//============================================================================
+	void DrawContoursAroundSegmentsTwoColors(
+		Mat&						bgr,
+		const Mat&					labels);
+#endif // OPENCV_SUPPORT
+
+	//============================================================================
+	// Working buffers for the following runs, NULL for the object's own.
+	// The scratch must outlive the runs.
+	//============================================================================
+	void SetScratch(
+		SlicScratch*				scratch);
+	//============================================================================
+	// Iteration cap and convergence tolerance (mean centroid movement in
+	// pixels, 0 = always run the cap) used by the following runs
+	//============================================================================
+	void SetIterationControl(
+		const int					maxIterations,
+		const double				tolerance);
+	//============================================================================
+	// Threads (0 = OpenMP default) and priority of the parallel k-means loops,
+	// set per run instead of through the global OpenMP state
+	//============================================================================
+	void SetThreading(
+		const int					threads,
+		const bool					lowPriority);
+	//============================================================================
+	// Residual and timing of every iteration of the last run
+	//============================================================================
+	const vector<SlicIterationStats>& GetIterationStats() const;
+
+	//============================================================================
+	// Micro-benchmark: time the reference RGB2LAB() path against the lookup
+	// table conversion used by DoRGBtoLABConversion() on the same buffer and
+	// report the largest absolute L, a or b deviation between the two.
+	//============================================================================
+	void BenchmarkRGBtoLABConversion(
+		const unsigned int*			ubuff,//Each 32 bit unsigned int contains ARGB pixel values.
+		const int					width,
+		const int					height,
+		double&						referenceMs,
+		double&						lookupMs,
+		double&						maxAbsDiff);
 
 private:
 
 	//============================================================================
 	// Magic SLIC. No need to set M (compactness factor) and S (step size).
 	// SLICO (SLIC Zero) varies only M dynamicaly, not S.
+	// Distances are kept in single precision and evaluated row by row with an
+	// SSE2/AVX kernel (scalar fallback when neither is available).
 	//============================================================================
 	void PerformSuperpixelSegmentation_VariableSandM(
 		vector<double>&				kseedsl,
@@ -108,7 +304,8 @@ private:
 		vector<double>&				kseedsy,
 		int*						klabels,
 		const int&					STEP,
-		const int&					NUMITR);
+		const int&					NUMITR,
+		const double&				maxShift = 0);//stop once the mean centroid movement is below, 0 runs all NUMITR
 	//============================================================================
 	// Pick seeds for superpixels when step size of superpixels is given.
 	//============================================================================
@@ -120,7 +317,20 @@ private:
 		vector<double>&				kseedsy,
 		const int&					STEP,
 		const bool&					perturbseeds,
-		const vector<double>&		edgemag);
+		const vector<float>&		edgemag);
+	//============================================================================
+	// Pick seeds from the centres of a previous frame, moved by (shiftx, shifty)
+	//============================================================================
+	void GetLABXYSeeds_FromPrevious(
+		vector<double>&				kseedsl,
+		vector<double>&				kseedsa,
+		vector<double>&				kseedsb,
+		vector<double>&				kseedsx,
+		vector<double>&				kseedsy,
+		const int&					STEP,
+		const SlicSeeds&			previous,
+		const double&				shiftx,
+		const double&				shifty);
 	//============================================================================
 	// Pick seeds for superpixels when number of superpixels is input.
 	//============================================================================
@@ -132,7 +342,7 @@ private:
 		vector<double>&				kseedsy,
 		const int&					STEP,
 		const bool&					perturbseeds,
-		const vector<double>&		edges);
+		const vector<float>&		edges);
 
 	//============================================================================
 	// Move the seeds to low gradient positions to avoid putting seeds at region boundaries.
@@ -143,17 +353,17 @@ private:
 		vector<double>&				kseedsb,
 		vector<double>&				kseedsx,
 		vector<double>&				kseedsy,
-		const vector<double>&		edges);
+		const vector<float>&		edges);
 	//============================================================================
 	// Detect color edges, to help PerturbSeeds()
 	//============================================================================
 	void DetectLabEdges(
-		const double*				lvec,
-		const double*				avec,
-		const double*				bvec,
+		const float*				lvec,
+		const float*				avec,
+		const float*				bvec,
 		const int&					width,
 		const int&					height,
-		vector<double>&				edges);
+		vector<float>&				edges);
 	//============================================================================
 	// xRGB to XYZ conversion; helper for RGB2LAB()
 	//============================================================================
@@ -175,13 +385,24 @@ private:
 		double&						aval,
 		double&						bval);
 	//============================================================================
-	// sRGB to CIELAB conversion for 2-D images
+	// Table driven sRGB to CIELAB conversion, same result as RGB2LAB() within
+	// the tolerance documented in SLIC.cpp
+	//============================================================================
+	void RGB2LAB_LUT(
+		const int&					sR,
+		const int&					sG,
+		const int&					sB,
+		double&						lval,
+		double&						aval,
+		double&						bval);
+	//============================================================================
+	// sRGB to CIELAB conversion for 2-D images, single precision planes
 	//============================================================================
 	void DoRGBtoLABConversion(
 		const unsigned int*&		ubuff,
-		double*&					lvec,
-		double*&					avec,
-		double*&					bvec);
+		vector<float>&				lvec,
+		vector<float>&				avec,
+		vector<float>&				bvec);
 	//============================================================================
 	// sRGB to CIELAB conversion for 3-D volumes
 	//============================================================================
@@ -193,12 +414,12 @@ private:
 
 	//============================================================================
 	// Post-processing of SLIC segmentation, to avoid stray labels.
+	// Relabels in place, see the union-find notes in SLIC.cpp.
 	//============================================================================
 	void EnforceLabelConnectivity(
-		const int*					labels,
+		int*						labels,//input labels that need to be corrected to remove stray labels
 		const int&					width,
 		const int&					height,
-		int*						nlabels,//input labels that need to be corrected to remove stray labels
 		int&						numlabels,//the number of labels changes in the end if segments are removed
 		const int&					K); //the number of superpixels desired by the user
 
@@ -208,13 +429,24 @@ private:
 	int										m_height;
 	int										m_depth;
 
-	double*									m_lvec;
-	double*									m_avec;
-	double*									m_bvec;
+	//Single precision structure-of-arrays LAB planes used by the 2-D core,
+	//borrowed from the SlicInputContext of the current run
+	const float*							m_lvec;
+	const float*							m_avec;
+	const float*							m_bvec;
 
 	double**								m_lvecvec;
 	double**								m_avecvec;
 	double**								m_bvecvec;
+
+	int										m_maxIterations;
+	double									m_tolerance;
+	int										m_threads;
+	bool									m_lowPriority;
+	vector<SlicIterationStats>				m_iterationStats;
+
+	SlicScratch								m_ownScratch;
+	SlicScratch*							m_scratch;//working buffers of the current run
 };
 
 #endif // !defined(_SLIC_H_INCLUDED_)
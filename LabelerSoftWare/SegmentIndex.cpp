@@ -0,0 +1,108 @@
+#include "SegmentIndex.h"
+#include <exception>
+
+SegmentIndex::SegmentIndex()
+{
+	_width = 0;
+	_height = 0;
+}
+
+void SegmentIndex::build(const int* labels, int width, int height, int numLabels, const Mat& image)
+{
+	const int sz = width*height;
+	_width = width;
+	_height = height;
+	/*pass 1: segment sizes, then their prefix sum*/
+	_offsets.assign(numLabels + 1, 0);
+	for (int i = 0; i < sz; i++)
+	{
+		int label = labels[i];
+		if (label < 0 || label >= numLabels) throw std::exception("label out of range while indexing segments");
+		_offsets[label + 1]++;
+	}
+	for (int k = 0; k < numLabels; k++) _offsets[k + 1] += _offsets[k];
+	/*pass 2: scatter the pixel indices, _offsets[k] walks to the start of segment k+1*/
+	_pixels.resize(sz);
+	for (int i = 0; i < sz; i++)
+	{
+		_pixels[_offsets[labels[i]]++] = i;
+	}
+	for (int k = numLabels; k > 0; k--) _offsets[k] = _offsets[k - 1];
+	_offsets[0] = 0;
+	buildMetadata(image);
+}
+
+void SegmentIndex::buildMetadata(const Mat& image)
+{
+	const int numSegments = size();
+	const bool withColor = !image.empty();
+	if (withColor && (image.type() != CV_8UC3 || image.cols != _width || image.rows != _height))
+		throw std::exception("segment colours need a CV_8UC3 image of the label size");
+	_bboxes.resize(numSegments);
+	_meanColors.assign(numSegments, cv::Vec3b(0, 0, 0));
+	_runOffsets.resize(numSegments + 1);
+	_runs.clear();
+	_runOffsets[0] = 0;
+	for (int k = 0; k < numSegments; k++)
+	{
+		int min_x = _width, min_y = _height, max_x = -1, max_y = -1;
+		double sum[3] = { 0, 0, 0 };
+		/*pixels are in raster order, a run ends where the next index is not the next pixel of the row*/
+		for (const int* it = begin(k); it != end(k);)
+		{
+			const int first = *it;
+			const int y = first / _width;
+			const int x = first - y*_width;
+			int length = 1;
+			for (++it; it != end(k) && *it == first + length && x + length < _width; ++it) length++;
+			SegmentRun run = { y, x, length };
+			_runs.push_back(run);
+			if (x < min_x) min_x = x;
+			if (x + length - 1 > max_x) max_x = x + length - 1;
+			if (y < min_y) min_y = y;
+			max_y = y;
+			if (withColor)
+			{
+				const uchar* p = image.ptr<uchar>(y) + 3 * x;
+				for (int i = 0; i < length; i++, p += 3)
+				{
+					sum[0] += p[0];
+					sum[1] += p[1];
+					sum[2] += p[2];
+				}
+			}
+		}
+		_runOffsets[k + 1] = int(_runs.size());
+		_bboxes[k] = max_x < 0 ? cv::Rect() : cv::Rect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+		const int n = count(k);
+		if (withColor && n > 0)
+		{
+			_meanColors[k] = cv::Vec3b(cv::saturate_cast<uchar>(sum[0] / n),
+				cv::saturate_cast<uchar>(sum[1] / n), cv::saturate_cast<uchar>(sum[2] / n));
+		}
+	}
+}
+
+cv::Rect SegmentIndex::bbox(const vector<int>& segments) const
+{
+	cv::Rect r;
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		const cv::Rect& b = _bboxes[segments[i]];
+		if (b.area() == 0) continue;
+		r = r.area() == 0 ? b : (r | b);
+	}
+	return r;
+}
+
+void SegmentIndex::clear()
+{
+	_offsets.clear();
+	_pixels.clear();
+	_bboxes.clear();
+	_meanColors.clear();
+	_runOffsets.clear();
+	_runs.clear();
+	_width = 0;
+	_height = 0;
+}
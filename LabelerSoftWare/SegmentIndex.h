@@ -0,0 +1,59 @@
+/*Pixels of every segment of a label image, stored in compressed sparse row form*/
+#pragma once
+#include <vector>
+#include <memory>
+#include "opencv.hpp"
+using std::vector;
+using std::shared_ptr;
+using cv::Point;
+using cv::Mat;
+
+/*horizontal run of pixels x .. x+length-1 on row y*/
+struct SegmentRun
+{
+	int y;
+	int x;
+	int length;
+};
+
+class SegmentIndex
+{
+public:
+	SegmentIndex();
+public:
+	/*
+	Counting sort of the pixels by label in two linear passes: the pixels of segment k
+	are the raster indices (y*width+x) pixels[offsets[k]] .. pixels[offsets[k+1]-1],
+	in raster order. Labels must lie in 0..numLabels-1. The buffers are reused when
+	the index is rebuilt.
+	Bounding boxes and horizontal runs of every segment are derived in a third pass,
+	mean colours as well when the CV_8UC3 image the labels belong to is given.
+	*/
+	void build(const int* labels, int width, int height, int numLabels, const Mat& image = Mat());
+	void clear();
+
+	int size() const { return _offsets.empty() ? 0 : int(_offsets.size()) - 1; }//number of segments
+	int width() const { return _width; }
+	int height() const { return _height; }
+	const int* begin(int segment) const { return _pixels.data() + _offsets[segment]; }
+	const int* end(int segment) const { return _pixels.data() + _offsets[segment + 1]; }
+	int count(int segment) const { return _offsets[segment + 1] - _offsets[segment]; }
+	Point point(int pixel) const { return Point(pixel % _width, pixel / _width); }
+	const cv::Rect& bbox(int segment) const { return _bboxes[segment]; }
+	const cv::Vec3b& meanColor(int segment) const { return _meanColors[segment]; }//channel order of the image, black without one
+	const SegmentRun* runsBegin(int segment) const { return _runs.data() + _runOffsets[segment]; }
+	const SegmentRun* runsEnd(int segment) const { return _runs.data() + _runOffsets[segment + 1]; }
+	cv::Rect bbox(const vector<int>& segments) const;//union of the boxes, empty for no segments
+private:
+	void buildMetadata(const Mat& image);
+private:
+	int _width;
+	int _height;
+	vector<int> _offsets;//size()+1 entries
+	vector<int> _pixels;//width*height entries
+	vector<cv::Rect> _bboxes;
+	vector<cv::Vec3b> _meanColors;
+	vector<int> _runOffsets;//size()+1 entries into _runs
+	vector<SegmentRun> _runs;
+};
+typedef shared_ptr<SegmentIndex> PtrSegmentIndex;
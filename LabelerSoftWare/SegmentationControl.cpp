@@ -1,11 +1,61 @@
 #include "SegmentationControl.h"
 #include <QDebug>
 #include "SLIC.h"
+#include "SuperpixelHierarchy.h"
+#include "SlicScratchArena.h"
+#include "SlicSegmenter.h"
+#include "MeanShiftSegmenter.h"
+#include <cmath>
+#include <algorithm>
+#include <QThread>
+#include <QMutexLocker>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 //#define COMPILE_TEST
+//#define BENCHMARK_LAB_CONVERSION
+//temporal SLIC stops once the mean centroid movement is below this fraction of the step
+const double TEMPORAL_CONVERGENCE_RATIO = 0.05;
+const int BACKGROUND_CORE_DIVISOR = 2;//background SLIC leaves the other cores to the level being labeled
+namespace
+{
+	/*
+	threads and priority of the segmentation of one control (not the global OpenMP state, other
+	segmentations run at the same time) and priority of the calling thread, restored when the
+	scope is left, also by an exception
+	*/
+	class BackgroundScope
+	{
+	public:
+		BackgroundScope(int& threads, bool& lowPriority) : _threads(threads), _lowPriority(lowPriority)
+		{
+			_savedThreads = threads;
+			_savedLowPriority = lowPriority;
+#ifdef _OPENMP
+			threads = std::max(1, omp_get_num_procs() / BACKGROUND_CORE_DIVISOR);
+#else
+			threads = 1;
+#endif
+			lowPriority = true;
+			QThread::currentThread()->setPriority(QThread::LowPriority);
+		}
+		~BackgroundScope()
+		{
+			QThread::currentThread()->setPriority(QThread::NormalPriority);
+			_threads = _savedThreads;
+			_lowPriority = _savedLowPriority;
+		}
+	private:
+		int& _threads;
+		bool& _lowPriority;
+		int _savedThreads;
+		bool _savedLowPriority;
+	};
+}
 #ifdef COMPILE_TEST
 namespace test
 {
-	void testSegments(PtrSegments& segs,int width,int height)
+	void testSegments(PtrSegmentIndex& segs,int width,int height)
 	{
 		Mat outPut(height,width,CV_8UC3);
 		outPut.setTo(0);
@@ -15,11 +65,10 @@ namespace test
 		for (int i = 0; i < labelNum; i++)
 		{
 			cv::Scalar color(cv::randu<uchar>(), cv::randu<uchar>(), cv::randu<uchar>());
-			PtrSegmentPoints pPts = (*segs)[i];
-			ptNum += pPts->size();
-			for (int j = 0; j < pPts->size(); j++)
+			ptNum += segs->count(i);
+			for (const int* it = segs->begin(i); it != segs->end(i); ++it)
 			{
-				Point pt = (*pPts)[j];
+				Point pt = segs->point(*it);
 				outPut.at<cv::Vec3b>(pt.y, pt.x)[0] = color[0];
 				outPut.at<cv::Vec3b>(pt.y, pt.x)[1] = color[1];
 				outPut.at<cv::Vec3b>(pt.y, pt.x)[2] = color[2];
@@ -31,16 +80,121 @@ namespace test
 }
 #endif // COMPILE_TEST
 
-SegmentationControl::SegmentationControl(const Mat& IMG, int slic_pixel_width)
+SharedSlicInput::SharedSlicInput(const Mat& IMG, SlicScratchArena* arena)
+{
+	_img = IMG;
+	_arena = arena;
+}
+
+PtrSlicInput SharedSlicInput::get()
+{
+	QMutexLocker locker(&_lock);
+	if (!_input)
+	{
+		_input = SegmentationControl::prepareSlicInput(_img, _arena);
+		_img = Mat();
+	}
+	return _input;
+}
+
+SegmentationControl::SegmentationControl(const Mat& IMG, int slic_pixel_width, PtrSharedSlicInput slicInput)
 {
 	assert(IMG.type() == CV_8UC3);
 	_originalIMG = IMG;
 	if (slic_pixel_width <= 0)
 		throw std::exception("slic pixel width cannot be smaller than 1");
 	_slic_pixel_width = slic_pixel_width;
+	_sharedSlicInput = slicInput;
+	_slicArena = NULL;
+	_temporal = false;
+	_warmShiftX = 0;
+	_warmShiftY = 0;
+	_slicMaxIterations = 10;
+	_slicTolerance = 0;
+	_threads = 0;
+	_lowPriority = false;
+	_slicBoundaryThickness = 1;
+	_labelStampGeneration = 0;
+	_brushX = 0;
+	_brushY = 0;
+	_brushRadius = -1;
+	_brushActive = false;
 	init();
 }
 
+void SegmentationControl::setSlicIterationControl(int maxIterations, double tolerance)
+{
+	_slicMaxIterations = maxIterations;
+	_slicTolerance = tolerance;
+}
+
+const vector<double>& SegmentationControl::getSlicResiduals()
+{
+	return _slicResiduals;
+}
+
+const vector<double>& SegmentationControl::getSlicIterationTimes()
+{
+	return _slicIterationTimes;
+}
+
+const Mat& SegmentationControl::getLabelImage()
+{
+	return _labelImg;
+}
+
+void SegmentationControl::setLabelImage(const Mat& labels, segmentationType type)
+{
+	if (labels.type() != CV_32S || labels.cols != _originalIMG.cols || labels.rows != _originalIMG.rows)
+		throw std::exception("labels do not match the image size");
+	setSegmentationType(type);
+	labels.copyTo(_labelImg);
+	applyLabelImage();
+}
+
+void SegmentationControl::setSlicBoundaryThickness(int thickness)
+{
+	if (thickness < 0)
+		throw std::exception("slic boundary thickness cannot be negative");
+	_slicBoundaryThickness = thickness;
+	if (!_slicBoundaryMask.empty()) drawBoundaries();
+}
+
+void SegmentationControl::setWarmStartSeeds(PtrSlicSeeds previous, double dx, double dy)
+{
+	_temporal = true;
+	_warmSeeds = previous;
+	_warmShiftX = dx;
+	_warmShiftY = dy;
+}
+
+PtrSlicSeeds SegmentationControl::getSlicSeeds()
+{
+	return _slicSeeds;
+}
+
+PtrSlicInput SegmentationControl::prepareSlicInput(const Mat& IMG, SlicScratchArena* arena)
+{
+	assert(IMG.type() == CV_8UC3);
+	int width = IMG.cols;
+	int height = IMG.rows;
+	shared_ptr<SlicInputContext> context = arena ? arena->acquireInputContext(width, height) : shared_ptr<SlicInputContext>(new SlicInputContext);
+	SLIC slic;
+	slic.PrepareInputContext(IMG, *context);//LAB planes straight from the BGR rows
+	return context;
+}
+
+void SegmentationControl::setSlicArena(SlicScratchArena* arena)
+{
+	_slicArena = arena;
+}
+
+shared_ptr<SlicScratch> SegmentationControl::acquireSlicScratch()
+{
+	if (_slicArena) return _slicArena->acquireScratch(_originalIMG.cols, _originalIMG.rows);
+	return shared_ptr<SlicScratch>(new SlicScratch);
+}
+
 SegmentationControl::~SegmentationControl()
 {
 
@@ -50,7 +204,7 @@ Mat& SegmentationControl::getMatRef(int idx)
 {
 	return _vecAllSegmentationTypeMats[idx];
 }
-PtrSegments& SegmentationControl::getSegmentsPtrRef(int idx)
+PtrSegmentIndex& SegmentationControl::getSegmentsPtrRef(int idx)
 {
 	return _vecAllSegmentationTypeSegments[idx];
 }
@@ -61,42 +215,161 @@ int& SegmentationControl::getSegmentsNumRef(int idx)
 
 void SegmentationControl::doMeanShiftSegmentation()
 {
-	//TODO
-	const int idx = getSegmentationType0basedIdx(MEAN_SHIFT);
-	Mat & mSegImg = getMatRef(idx);
-	PtrSegments& pSegments = getSegmentsPtrRef(idx);
-	int &iSegNum = getSegmentsNumRef(idx);
+	runSegmenter(MEAN_SHIFT);
+	qDebug() << "mean shift pixel width" << _slic_pixel_width << "segments:" << getSegmentationSegmentsNumOfType(MEAN_SHIFT);
+}
+
+void SegmentationControl::setSegmenter(segmentationType type, PtrSegmenter segmenter)
+{
+	_segmenters[getSegmentationType0basedIdx(type)] = segmenter;
+}
+
+PtrSegmenter SegmentationControl::getSegmenter(segmentationType type)
+{
+	return _segmenters[getSegmentationType0basedIdx(type)];
+}
+
+void SegmentationControl::runSegmenter(segmentationType type)
+{
+	PtrSegmenter segmenter = getSegmenter(type);
+	if (!segmenter)
+		throw std::exception("no segmenter for this segmentation type");
+	setSegmentationType(type);
+	segmenter->setThreading(_threads, _lowPriority);
+	segmenter->segment(_originalIMG, _labelImg);
+	applyLabelImage();
+}
 
-	qDebug() << "TODO add meanshift seg";
+void SegmentationControl::processBackgroundSegmentation(segmentationType type)
+{
+	BackgroundScope background(_threads, _lowPriority);
+	processSegmentation(type);
 }
 
 void SegmentationControl::doSlicSegmentation()
 {
 	int width = _originalIMG.cols;
 	int height = _originalIMG.rows;
-	int sz = width*height;
-	unsigned int * IMG = NULL;
 	int* labels = NULL;
-	IMG = new unsigned int[width*height];
 	_labelImg.create(height, width, CV_32S);
 	labels = (int*)_labelImg.data;
-	if (IMG == nullptr) { throw exception("not Enough Memory"); }
-	slic::CopyMatToMem(_originalIMG, IMG, width, height);
+	//LAB conversion and edges are done once per frame and shared by all scales
+	if (!_slicInput) _slicInput = _sharedSlicInput ? _sharedSlicInput->get() : prepareSlicInput(_originalIMG, _slicArena);
+	if (_slicInput->width != width || _slicInput->height != height)
+		throw std::exception("slic input does not match the image size");
+#ifdef BENCHMARK_LAB_CONVERSION
+	{
+		double referenceMs(0), lookupMs(0), maxAbsDiff(0);
+		vector<unsigned int> argb(width*height);
+		slic::CopyMatToMem(_originalIMG, argb.data(), width, height);
+		SLIC bench;
+		bench.BenchmarkRGBtoLABConversion(argb.data(), width, height, referenceMs, lookupMs, maxAbsDiff);
+		qDebug() << "RGB2LAB reference:" << referenceMs << "ms, lookup table:" << lookupMs << "ms, max |LAB diff|:" << maxAbsDiff;
+	}
+#endif // BENCHMARK_LAB_CONVERSION
+	setSegmentationType(SLIC_);
+	vector<SlicIterationStats> stats;
+	if (_temporal)
+	{
+		//warm start carries seeds from frame to frame, it stays outside of the Segmenter interface
+		shared_ptr<SlicScratch> scratch = acquireSlicScratch();
+		SLIC slic;
+		int numlabels(0);
+		slic.SetScratch(scratch.get());
+		slic.SetIterationControl(_slicMaxIterations, _slicTolerance);
+		slic.SetThreading(_threads, _lowPriority);
+		PtrSlicSeeds seeds(new SlicSeeds);
+		if (_warmSeeds) *seeds = *_warmSeeds;
+		double tolerance = _slicTolerance > 0 ? _slicTolerance : TEMPORAL_CONVERGENCE_RATIO*_slic_pixel_width;
+		slic.PerformSLICO_WarmStart(*_slicInput, labels, numlabels, _slic_pixel_width, *seeds,
+			_warmShiftX, _warmShiftY, tolerance);
+		_slicSeeds = seeds;
+		stats = slic.GetIterationStats();
+	}
+	else
+	{
+		PtrSegmenter segmenter = getSegmenter(SLIC_);
+		SlicSegmenter* slic = dynamic_cast<SlicSegmenter*>(segmenter.get());
+		if (slic)
+		{
+			slic->setInput(_slicInput);
+			slic->setArena(_slicArena);
+			slic->setIterationControl(_slicMaxIterations, _slicTolerance);
+		}
+		segmenter->setThreading(_threads, _lowPriority);
+		segmenter->segment(_originalIMG, _labelImg);
+		if (slic) stats = slic->getIterationStats();
+	}
+	_slicResiduals.resize(stats.size());
+	_slicIterationTimes.resize(stats.size());
+	QString report;
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		_slicResiduals[i] = stats[i].residual;
+		_slicIterationTimes[i] = stats[i].ms;
+		report += QString(" %1px/%2ms").arg(stats[i].residual, 0, 'f', 3).arg(stats[i].ms, 0, 'f', 1);
+	}
+	qDebug() << "SLIC step" << _slic_pixel_width << "iterations:" << stats.size() << report;
+	applyLabelImage();
+  //simple progessbar not thread safe. Only to show simply.
+}
+
+void SegmentationControl::applyLabelImage()
+{
 	SLIC slic;
-	int numlabels(0);
-	double dummyM(0);
-	slic.PerformSLICO_ForGivenStepSize(IMG, width, height, labels, numlabels, _slic_pixel_width, dummyM);
-	slic.DrawContoursAroundSegmentsTwoColors(IMG, labels, width, height);
+	slic.ComputeBoundaryMask(_labelImg, _slicBoundaryMask);
 	//updateSegmentsStorageWithLabelImage(segmentationType::SLIC_, labels, width, height);
-	updateSegmentsStorageWithLabelImage(segmentationType::SLIC_, _labelImg);
-	Mat outIMG;
-	slic::CopyMemToMat(outIMG, IMG, width, height);
+	updateSegmentsStorageWithLabelImage(getSegmentationType(), _labelImg);
+	drawBoundaries();
+}
+
+void SegmentationControl::drawBoundaries()
+{
+	Mat outIMG = _originalIMG.clone();
+	SLIC slic;
+	slic.DrawBoundaryMask(outIMG, _slicBoundaryMask, _slicBoundaryThickness);
 	//cv::imshow("image", outIMG);
 	//cv::waitKey(1);
-	int idx = getSegmentationType0basedIdx(segmentationType::SLIC_);
+	int idx = getSegmentationType0basedIdx(getSegmentationType());
 	getMatRef(idx) = outIMG;
-	delete[]IMG;
-  //simple progessbar not thread safe. Only to show simply.
+}
+
+void SegmentationControl::doHierarchicalSlicSegmentation(vector<SegmentationControl*> levels)
+{
+	if (levels.empty()) return;
+	SegmentationControl* finest = levels[0];
+	for (size_t i = 1; i < levels.size(); i++)
+	{
+		if (levels[i]->_slic_pixel_width < finest->_slic_pixel_width) finest = levels[i];
+	}
+	finest->setSegmentationType(SLIC_);
+	finest->doSlicSegmentation();
+
+	/*a coarser level of pixel width w gets as many segments as SLIC would seed: sz/(w*w)*/
+	int width = finest->_labelImg.cols;
+	int height = finest->_labelImg.rows;
+	int sz = width*height;
+	vector<SegmentationControl*> coarse;
+	vector<int> targetCounts;
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		if (levels[i] == finest) continue;
+		int w = levels[i]->_slic_pixel_width;
+		coarse.push_back(levels[i]);
+		targetCounts.push_back(std::max(1, sz / (w*w)));
+	}
+	vector<vector<int> > levelLabels;
+	SuperpixelHierarchy::buildLevels(*finest->_slicInput, (int*)finest->_labelImg.data,
+		finest->getSegmentationSegmentsNumOfType(SLIC_), targetCounts, levelLabels);
+	for (size_t i = 0; i < coarse.size(); i++)
+	{
+		SegmentationControl* ctrl = coarse[i];
+		ctrl->setSegmentationType(SLIC_);
+		ctrl->_slicInput = finest->_slicInput;
+		ctrl->_labelImg.create(height, width, CV_32S);
+		std::copy(levelLabels[i].begin(), levelLabels[i].end(), (int*)ctrl->_labelImg.data);
+		ctrl->applyLabelImage();
+	}
 }
 
 int SegmentationControl::getSegmentationTypeNum()
@@ -111,6 +384,9 @@ void SegmentationControl::processSegmentation(segmentationType type)
 	case MEAN_SHIFT:
 		doMeanShiftSegmentation();
 		break;
+	case SLIC_:
+		doSlicSegmentation();
+		break;
 	default:
 		break;
 	}
@@ -133,7 +409,7 @@ Mat SegmentationControl::getSegmentationMatOfType(segmentationType type)
 	return _vecAllSegmentationTypeMats[idx];
 }
 
-PtrSegments SegmentationControl::getSegmentationSegmentsOfType(segmentationType type)
+PtrSegmentIndex SegmentationControl::getSegmentationSegmentsOfType(segmentationType type)
 {
 	int idx = getSegmentationType0basedIdx(type);
 	return _vecAllSegmentationTypeSegments[idx];
@@ -150,13 +426,6 @@ int SegmentationControl::getLabel(Mat Img, int x, int y)
 	return Img.at<int>(y, x);
 }
 
-PtrSegmentPoints SegmentationControl::getSegmentOfType(segmentationType type, int segment_Idx)
-{
-	PtrSegments pSegs = getSegmentationSegmentsOfType(type);
-	PtrSegmentPoints pSegPts = (*pSegs)[segment_Idx];
-	return pSegPts;
-}
-
 bool SegmentationControl::init()
 {
 	_segType = DUMMY_FIRST;
@@ -166,8 +435,11 @@ bool SegmentationControl::init()
 	_vecSegmentationSegmentsNum.resize(count);
 	for (int i = 0; i < count; i++)
 	{
-		(_vecAllSegmentationTypeSegments[i]).reset(new Segments);
+		(_vecAllSegmentationTypeSegments[i]).reset(new SegmentIndex);
 	}
+	_segmenters.resize(count);
+	setSegmenter(MEAN_SHIFT, MeanShiftSegmenter::forPixelWidth(_slic_pixel_width));
+	setSegmenter(SLIC_, PtrSegmenter(new SlicSegmenter(_slic_pixel_width)));
 	return true;
 }
 
@@ -191,7 +463,7 @@ void SegmentationControl::setSegmentationMatOfType(segmentationType type, Mat& I
 	int idx = getSegmentationType0basedIdx(type);
 	_vecAllSegmentationTypeMats[idx] = IMG;
 }
-void SegmentationControl::setSegmentationSegmentsOfType(segmentationType type, PtrSegments segs)
+void SegmentationControl::setSegmentationSegmentsOfType(segmentationType type, PtrSegmentIndex segs)
 {
 	int idx = getSegmentationType0basedIdx(type);
 	_vecAllSegmentationTypeSegments[idx] = segs;
@@ -201,11 +473,6 @@ void SegmentationControl::setSegmentationNumOfType(segmentationType type, int nu
 	int idx = getSegmentationType0basedIdx(type);
 	_vecSegmentationSegmentsNum[idx] = num;
 }
-void SegmentationControl::setSegmentOfType(segmentationType type, int segment_Idx, PtrSegmentPoints segPts)
-{
-	PtrSegments pSegs = getSegmentationSegmentsOfType(type);
-	(*pSegs)[segment_Idx] = segPts;
-}
 
 Mat& SegmentationControl::getSlicSegResultRef()
 {
@@ -215,7 +482,13 @@ Mat& SegmentationControl::getSlicSegResultRef()
 
 Mat& SegmentationControl::getMeanShiftSegResultRef()
 {
-	return Mat();
+	int idx = getSegmentationType0basedIdx(segmentationType::MEAN_SHIFT);
+	return getMatRef(idx);
+}
+
+Mat& SegmentationControl::getSegResultRef()
+{
+	return getMatRef(getSegmentationType0basedIdx(getSegmentationType()));
 }
 
 void SegmentationControl::updateSegmentsStorageWithLabelImage(segmentationType type, Mat& labelImg)
@@ -237,26 +510,14 @@ void SegmentationControl::updateSegmentsStorageWithLabelImage(segmentationType t
 		}
 	}
 	this->setSegmentationNumOfType(type, maxlabelIndex + 1);
-	PtrSegments pSegs = this->getSegmentsPtrRef(idx);
+	PtrSegmentIndex pSegs = this->getSegmentsPtrRef(idx);
 	assert(pSegs.get() != NULL);
-	pSegs->resize(maxlabelIndex + 1);
-	for (int i = 0; i < height; i++)
-	{
-		for (int j = 0; j < width; j++)
-		{
-			int label = plabelImg[i*width + j];
-			if ((*pSegs)[label].get() == NULL)
-			{
-				(*pSegs)[label].reset(new SementPoints);
-				(*pSegs)[label]->reserve(500);
-			}
-			(*pSegs)[label]->push_back(Point(j, i));
-		}
-	}
-	for (int i = 0; i < maxlabelIndex + 1; i++)
-	{
-		(*pSegs)[i]->shrink_to_fit();
-	}
+	pSegs->build(plabelImg, width, height, maxlabelIndex + 1, _originalIMG);
+	resetBrushCache();
+	_brushLabelCount.assign(maxlabelIndex + 1, 0);
+	_brushIdPos.assign(maxlabelIndex + 1, -1);
+	_labelStamp.assign(maxlabelIndex + 1, 0);
+	_labelStampGeneration = 0;
 #ifdef COMPILE_TEST
 	test::testSegments(pSegs, width, height);
 #endif//COMPILE_TEST
@@ -304,24 +565,141 @@ void SegmentationControl::updateSegmentsStorageWithLabelImage(segmentationType t
 
 void SegmentationControl::slotReceivePts(vector<Point>* vecPts)
 {
-	_tempVecPts.clear();
-	vector<int> labelCache;
-	labelCache.reserve(30);
+	_tempSegmentIds.clear();
 	segmentationType type = getSegmentationType();
 	int idx = getSegmentationType0basedIdx(type);
-	PtrSegments pSegs = _vecAllSegmentationTypeSegments[idx];
+	PtrSegmentIndex pSegs = _vecAllSegmentationTypeSegments[idx];
+	/*a new generation marks every label unvisited without clearing the stamps*/
+	if (++_labelStampGeneration == 0)
+	{
+		std::fill(_labelStamp.begin(), _labelStamp.end(), 0);
+		_labelStampGeneration = 1;
+	}
+	const int width = _labelImg.cols;
+	const int* plabelImg = (const int*)_labelImg.data;
 	for (size_t i = 0; i < vecPts->size(); i++)
 	{
 		Point pt = (*vecPts)[i];
-		int label = _labelImg.at<int>(pt.y, pt.x);
-		if (std::find(labelCache.begin(), labelCache.end(), label) != labelCache.end())
+		int label = plabelImg[pt.y*width + pt.x];
+		if (_labelStamp[label] == _labelStampGeneration)
 		{
 			continue;
 		}
-		labelCache.push_back(label);
-		PtrSegmentPoints pSegPts = (*pSegs)[label];
-		_tempVecPts.push_back(pSegPts);
+		_labelStamp[label] = _labelStampGeneration;
+		_tempSegmentIds.push_back(label);
+	}
+	emit signalSendPts(pSegs.get(), &_tempSegmentIds);
+}
+
+void SegmentationControl::slotReceiveBrush(int x, int y, int radius)
+{
+	if (_labelImg.empty()) return;
+	if (radius < 0) radius = 0;
+	const int height = _labelImg.rows;
+	if (!_brushActive || radius != _brushRadius)
+	{
+		resetBrushCache();
+		_brushRadius = radius;
+		_brushHalfWidth.resize(radius + 1);
+		for (int dy = 0; dy <= radius; dy++)
+		{
+			/*same disk as Surface::getCircleInnerPoints: dx*dx + dy*dy <= radius*radius*/
+			int w = int(std::sqrt(double(radius*radius - dy*dy)));
+			while (w*w + dy*dy > radius*radius) w--;
+			while ((w + 1)*(w + 1) + dy*dy <= radius*radius) w++;
+			_brushHalfWidth[dy] = w;
+		}
+		for (int row = std::max(0, y - radius); row <= std::min(height - 1, y + radius); row++)
+		{
+			int x0, x1;
+			brushDiskSpan(x, y, row, x0, x1);
+			addBrushSpanDifference(row, x0, x1, 0, -1, 1);
+		}
+		_brushActive = true;
+	}
+	else if (x != _brushX || y != _brushY)
+	{
+		/*only the pixels of the rows that differ between the old and the new disk*/
+		int top = std::max(0, std::min(y, _brushY) - radius);
+		int bottom = std::min(height - 1, std::max(y, _brushY) + radius);
+		for (int row = top; row <= bottom; row++)
+		{
+			int n0, n1, o0, o1;
+			brushDiskSpan(x, y, row, n0, n1);
+			brushDiskSpan(_brushX, _brushY, row, o0, o1);
+			addBrushSpanDifference(row, n0, n1, o0, o1, 1);
+			addBrushSpanDifference(row, o0, o1, n0, n1, -1);
+		}
+	}
+	_brushX = x;
+	_brushY = y;
+	int idx = getSegmentationType0basedIdx(getSegmentationType());
+	emit signalSendPts(_vecAllSegmentationTypeSegments[idx].get(), &_brushSegmentIds);
+}
+
+void SegmentationControl::resetBrushCache()
+{
+	for (size_t i = 0; i < _brushSegmentIds.size(); i++)
+	{
+		_brushLabelCount[_brushSegmentIds[i]] = 0;
+		_brushIdPos[_brushSegmentIds[i]] = -1;
+	}
+	_brushSegmentIds.clear();
+	_brushActive = false;
+}
+
+void SegmentationControl::brushDiskSpan(int cx, int cy, int y, int& x0, int& x1)
+{
+	int dy = std::abs(y - cy);
+	if (dy > _brushRadius)
+	{
+		x0 = 0;
+		x1 = -1;
+		return;
+	}
+	x0 = std::max(0, cx - _brushHalfWidth[dy]);
+	x1 = std::min(_labelImg.cols - 1, cx + _brushHalfWidth[dy]);
+}
+
+void SegmentationControl::addBrushSpanDifference(int y, int a0, int a1, int b0, int b1, int delta)
+{
+	if (a0 > a1) return;
+	const int* row = _labelImg.ptr<int>(y);
+	if (b0 > b1 || b1 < a0 || b0 > a1)
+	{
+		addBrushRun(row, a0, a1, delta);
+		return;
+	}
+	if (a0 < b0) addBrushRun(row, a0, b0 - 1, delta);
+	if (a1 > b1) addBrushRun(row, b1 + 1, a1, delta);
+}
+
+void SegmentationControl::addBrushRun(const int* row, int x0, int x1, int delta)
+{
+	for (int x = x0; x <= x1;)
+	{
+		/*pixels of one label come in runs, count them at once*/
+		const int label = row[x];
+		int n = 1;
+		while (x + n <= x1 && row[x + n] == label) n++;
+		x += n;
+		int& count = _brushLabelCount[label];
+		const bool wasCovered = count > 0;
+		count += delta*n;
+		if (!wasCovered && count > 0)
+		{
+			_brushIdPos[label] = int(_brushSegmentIds.size());
+			_brushSegmentIds.push_back(label);
+		}
+		else if (wasCovered && count == 0)
+		{
+			int pos = _brushIdPos[label];
+			int last = _brushSegmentIds.back();
+			_brushSegmentIds[pos] = last;
+			_brushIdPos[last] = pos;
+			_brushSegmentIds.pop_back();
+			_brushIdPos[label] = -1;
+		}
 	}
-	emit signalSendPts(&_tempVecPts);
 
 }
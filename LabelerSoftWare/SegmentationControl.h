@@ -1,17 +1,36 @@
 #pragma once
 #include <QObject>
+#include <QMutex>
 #include "opencv.hpp"
 #include <vector>
 #include <memory>
 #include <QProgressBar>
+#include "SegmentIndex.h"
+#include "Segmenter.h"
 using std::shared_ptr;
 using cv::Mat;
 using std::vector;
 using cv::Point;
-typedef vector<Point> SementPoints;
-typedef shared_ptr<SementPoints> PtrSegmentPoints;
-typedef vector<PtrSegmentPoints> Segments;
-typedef shared_ptr<vector<PtrSegmentPoints> > PtrSegments;
+struct SlicInputContext;
+typedef shared_ptr<const SlicInputContext> PtrSlicInput;
+struct SlicSeeds;
+typedef shared_ptr<SlicSeeds> PtrSlicSeeds;
+struct SlicScratch;
+class SlicScratchArena;
+/*SLIC input of a frame shared by all its scales, prepared by the first scale that needs it*/
+class SharedSlicInput
+{
+public:
+	SharedSlicInput(const Mat& IMG, SlicScratchArena* arena = NULL);
+	PtrSlicInput get();//thread safe, prepares the input on the first call
+private:
+	QMutex _lock;
+	Mat _img;
+	SlicScratchArena* _arena;
+	PtrSlicInput _input;
+};
+typedef shared_ptr<SharedSlicInput> PtrSharedSlicInput;
+
 class SegmentationControl:public QObject
 {
 	Q_OBJECT
@@ -20,30 +39,52 @@ public:
 	enum segmentationType { DUMMY_FIRST = 0, MEAN_SHIFT, SLIC_, DUMMY_LAST }_segType;
 
 public:
-	explicit SegmentationControl(const Mat& IMG,int slic_pixel_width=10);
+	explicit SegmentationControl(const Mat& IMG,int slic_pixel_width=10, PtrSharedSlicInput slicInput = PtrSharedSlicInput());
 	~SegmentationControl();
 public:
+	/*ARGB, LAB planes and edges of IMG, shared read-only by all scales of a frame*/
+	static PtrSlicInput prepareSlicInput(const Mat& IMG, SlicScratchArena* arena = NULL);
+	/*SLIC working buffers are taken from arena (owned by the session) instead of the heap*/
+	void setSlicArena(SlicScratchArena* arena);
 	/*various segmentations*/
 	void doMeanShiftSegmentation();
 	void doSlicSegmentation();
+	/*backend of a segmentation type, by default SlicSegmenter for SLIC_ and MeanShiftSegmenter for MEAN_SHIFT*/
+	void setSegmenter(segmentationType type, PtrSegmenter segmenter);
+	PtrSegmenter getSegmenter(segmentationType type);
+	/*processSegmentation at low thread priority on part of the cores, for levels nobody is waiting for yet*/
+	void processBackgroundSegmentation(segmentationType type);
+	/*SLIC once at the smallest pixel width of levels, the other levels are merged from it*/
+	static void doHierarchicalSlicSegmentation(vector<SegmentationControl*> levels);
+	/*temporal mode: start SLIC from the seeds of the previous frame moved by (dx,dy), null seeds for a fresh grid*/
+	void setWarmStartSeeds(PtrSlicSeeds previous, double dx, double dy);
+	PtrSlicSeeds getSlicSeeds();//converged seeds of the last temporal SLIC run, null otherwise
+	/*SLIC iteration cap and mean centroid movement tolerance in pixels (0: always run the cap)*/
+	void setSlicIterationControl(int maxIterations, double tolerance);
+	const vector<double>& getSlicResiduals();//mean centroid movement of every iteration of the last SLIC run
+	const vector<double>& getSlicIterationTimes();//milliseconds of every iteration of the last SLIC run
+	const Mat& getLabelImage();//CV_32S labels of the last segmentation
+	/*take labels computed elsewhere (e.g. in the background) instead of segmenting*/
+	void setLabelImage(const Mat& labels, segmentationType type = SLIC_);
+	/*redraw the overlay from the stored boundary mask, thickness of the dark band around the line*/
+	void setSlicBoundaryThickness(int thickness);
 
 	Mat& getMeanShiftSegResultRef();
 	Mat& getSlicSegResultRef();
+	Mat& getSegResultRef();//overlay of the current segmentation type
 	/***********************/
 
 	int getSegmentationType0basedIdx(segmentationType type);
 	int getSegmentationTypeNum();
 	Mat getSegmentationMatOfType(segmentationType type);
-	PtrSegments getSegmentationSegmentsOfType(segmentationType type);
+	PtrSegmentIndex getSegmentationSegmentsOfType(segmentationType type);
 	int getSegmentationSegmentsNumOfType(segmentationType type);
-	PtrSegmentPoints getSegmentOfType(segmentationType type, int segment_Idx);
 	int getLabel(Mat Img, int x, int y);
 
 	void setSegmentationTypeNum(segmentationType type, int count);
 	void setSegmentationMatOfType(segmentationType type, Mat& IMG);
-	void setSegmentationSegmentsOfType(segmentationType type, PtrSegments segs);
+	void setSegmentationSegmentsOfType(segmentationType type, PtrSegmentIndex segs);
 	void setSegmentationNumOfType(segmentationType type, int num);
-	void setSegmentOfType(segmentationType type, int segment_Idx, PtrSegmentPoints segPts);
 
 	void setSegmentationType(segmentationType type);
 	segmentationType getSegmentationType();
@@ -51,24 +92,61 @@ public:
 	void processSegmentations();
 
 signals:
-	void signalSendPts(vector<PtrSegmentPoints>* vecPts);
+	void signalSendPts(const SegmentIndex* index, vector<int>* segmentIds);//segments under the cursor
 public slots:
 void slotReceivePts(vector<Point>* vecPts);
+/*segments under a disk brush of radius (image pixels) at (x,y); only the pixels entered and left since the last position are looked up*/
+void slotReceiveBrush(int x, int y, int radius);
 
 private:
 	bool init();
+	void runSegmenter(segmentationType type);//labels from the backend of type, then applyLabelImage
+	void applyLabelImage();//draw contours of _labelImg and update the segment storage of the current type
+	void drawBoundaries();//overlay of the current type from _slicBoundaryMask
+	void resetBrushCache();//forget the brush, e.g. after the labels changed
+	void addBrushSpanDifference(int y, int a0, int a1, int b0, int b1, int delta);//delta for pixels of row y in [a0,a1] but not in [b0,b1]
+	void addBrushRun(const int* row, int x0, int x1, int delta);
+	void brushDiskSpan(int cx, int cy, int y, int& x0, int& x1);//row span of the brush disk, empty when x0 > x1
+	shared_ptr<SlicScratch> acquireSlicScratch();
 	void updateSegmentsStorageWithLabelImage(segmentationType type, Mat& labelImg);//update _vecAllSegmentationTypeSegments and _vecSegmentationSegmentsNum
 	//void updateSegmentsStorageWithLabelImage(segmentationType type, int* plabelImg, int width, int height);//update _vecAllSegmentationTypeSegments and _vecSegmentationSegmentsNum
 	Mat& getMatRef(int idx);
-	PtrSegments& getSegmentsPtrRef(int idx);
+	PtrSegmentIndex& getSegmentsPtrRef(int idx);
 	int& getSegmentsNumRef(int idx);
 private:
 	Mat _originalIMG;
 	Mat _labelImg;
 	vector<Mat> _vecAllSegmentationTypeMats;
-	vector<PtrSegments> _vecAllSegmentationTypeSegments;
+	vector<PtrSegmentIndex> _vecAllSegmentationTypeSegments;
+	vector<PtrSegmenter> _segmenters;
 	vector<int> _vecSegmentationSegmentsNum;
-	vector<PtrSegmentPoints> _tempVecPts;
+	vector<int> _tempSegmentIds;
+	vector<unsigned int> _labelStamp;//label visited in the current slotReceivePts call when equal to _labelStampGeneration
+	unsigned int _labelStampGeneration;
+	vector<int> _brushLabelCount;//brush pixels per label
+	vector<int> _brushIdPos;//position of the label in _brushSegmentIds, -1 if not under the brush
+	vector<int> _brushSegmentIds;
+	vector<int> _brushHalfWidth;//half width of the disk rows, indexed by |dy|
+	int _brushX;
+	int _brushY;
+	int _brushRadius;
+	bool _brushActive;
 	int _slic_pixel_width;
+	PtrSharedSlicInput _sharedSlicInput;
+	PtrSlicInput _slicInput;//null until SLIC runs
+	SlicScratchArena* _slicArena;
+	bool _temporal;
+	PtrSlicSeeds _warmSeeds;
+	double _warmShiftX;
+	double _warmShiftY;
+	PtrSlicSeeds _slicSeeds;
+	int _slicMaxIterations;
+	double _slicTolerance;
+	int _threads;//of the parallel segmentation loops, 0: OpenMP default
+	bool _lowPriority;//segmentation threads below normal priority
+	vector<double> _slicResiduals;
+	vector<double> _slicIterationTimes;
+	Mat _slicBoundaryMask;
+	int _slicBoundaryThickness;
 };
 
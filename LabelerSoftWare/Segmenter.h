@@ -0,0 +1,26 @@
+/*Interface of the superpixel backends dispatched by SegmentationControl*/
+#pragma once
+#include <memory>
+#include "opencv.hpp"
+using cv::Mat;
+using std::shared_ptr;
+
+class Segmenter
+{
+public:
+	Segmenter() : _threads(0), _lowPriority(false) {}
+	virtual ~Segmenter() {}
+	/*
+	Segment a CV_8UC3 BGR image. labels is (re)allocated as CV_32S of the same size,
+	every pixel gets a label in [0, returned count) and every label is used.
+	May be called from a worker thread.
+	*/
+	virtual int segment(const Mat& bgr, Mat& labels) = 0;
+	virtual const char* name() const = 0;
+	/*threads of the parallel loops of segment() (0: OpenMP default) and whether they run below normal priority*/
+	void setThreading(int threads, bool lowPriority) { _threads = threads; _lowPriority = lowPriority; }
+protected:
+	int _threads;
+	bool _lowPriority;
+};
+typedef shared_ptr<Segmenter> PtrSegmenter;
@@ -0,0 +1,49 @@
+#include "SlicScratchArena.h"
+#include <QMutexLocker>
+
+SlicScratchArena::SlicScratchArena()
+{
+}
+
+SlicScratchArena::~SlicScratchArena()
+{
+}
+
+template<typename T>
+shared_ptr<T> SlicScratchArena::acquire(vector<shared_ptr<T> >& pool, int width, int height)
+{
+	QMutexLocker locker(&_lock);
+	/*a pooled object is free when the pool holds the only reference*/
+	for (size_t i = 0; i < pool.size(); i++)
+	{
+		if (pool[i].use_count() == 1 && pool[i]->width == width && pool[i]->height == height)
+			return pool[i];
+	}
+	/*resolution changed: free buffers of other sizes are of no use any more*/
+	for (size_t i = pool.size(); i-- > 0;)
+	{
+		if (pool[i].use_count() == 1) pool.erase(pool.begin() + i);
+	}
+	shared_ptr<T> item(new T);
+	item->width = width;
+	item->height = height;
+	pool.push_back(item);
+	return item;
+}
+
+shared_ptr<SlicScratch> SlicScratchArena::acquireScratch(int width, int height)
+{
+	return acquire(_scratches, width, height);
+}
+
+shared_ptr<SlicInputContext> SlicScratchArena::acquireInputContext(int width, int height)
+{
+	return acquire(_inputs, width, height);
+}
+
+void SlicScratchArena::clear()
+{
+	QMutexLocker locker(&_lock);
+	_scratches.clear();
+	_inputs.clear();
+}
@@ -0,0 +1,32 @@
+/*Pool of SLIC working buffers and per-frame inputs, owned by the labeling session*/
+#pragma once
+#include <memory>
+#include <vector>
+#include <QMutex>
+#include "SLIC.h"
+using std::shared_ptr;
+using std::vector;
+
+class SlicScratchArena
+{
+public:
+	SlicScratchArena();
+	~SlicScratchArena();
+public:
+	/*
+	A scratch of the given size that no one else holds. It goes back to the pool
+	when the last copy of the returned pointer is released, so the buffers of one
+	frame are handed to the next frame of the same resolution without reallocating.
+	*/
+	shared_ptr<SlicScratch> acquireScratch(int width, int height);
+	/*same for the per-frame SLIC input (ARGB, LAB planes, edges)*/
+	shared_ptr<SlicInputContext> acquireInputContext(int width, int height);
+	void clear();
+private:
+	template<typename T>
+	shared_ptr<T> acquire(vector<shared_ptr<T> >& pool, int width, int height);
+private:
+	QMutex _lock;
+	vector<shared_ptr<SlicScratch> > _scratches;
+	vector<shared_ptr<SlicInputContext> > _inputs;
+};
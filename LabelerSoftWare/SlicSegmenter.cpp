@@ -0,0 +1,63 @@
+#include "SlicSegmenter.h"
+#include "SlicScratchArena.h"
+
+SlicSegmenter::SlicSegmenter(int step)
+{
+	if (step <= 0)
+		throw std::exception("slic step cannot be smaller than 1");
+	_step = step;
+	_arena = NULL;
+	_maxIterations = 10;
+	_tolerance = 0;
+}
+
+SlicSegmenter::~SlicSegmenter()
+{
+}
+
+void SlicSegmenter::setInput(shared_ptr<const SlicInputContext> input)
+{
+	_input = input;
+}
+
+void SlicSegmenter::setArena(SlicScratchArena* arena)
+{
+	_arena = arena;
+}
+
+void SlicSegmenter::setIterationControl(int maxIterations, double tolerance)
+{
+	_maxIterations = maxIterations;
+	_tolerance = tolerance;
+}
+
+int SlicSegmenter::segment(const Mat& bgr, Mat& labels)
+{
+	assert(bgr.type() == CV_8UC3);
+	const int width = bgr.cols;
+	const int height = bgr.rows;
+	shared_ptr<const SlicInputContext> input = _input;
+	if (!input || input->width != width || input->height != height)
+	{
+		shared_ptr<SlicInputContext> context = _arena ? _arena->acquireInputContext(width, height) : shared_ptr<SlicInputContext>(new SlicInputContext);
+		SLIC prepare;
+		prepare.PrepareInputContext(bgr, *context);
+		input = context;
+	}
+	shared_ptr<SlicScratch> scratch = _arena ? _arena->acquireScratch(width, height) : shared_ptr<SlicScratch>(new SlicScratch);
+	labels.create(height, width, CV_32S);
+	SLIC slic;
+	int numlabels(0);
+	double dummyM(0);
+	slic.SetScratch(scratch.get());
+	slic.SetIterationControl(_maxIterations, _tolerance);
+	slic.SetThreading(_threads, _lowPriority);
+	slic.PerformSLICO_ForGivenStepSize(*input, (int*)labels.data, numlabels, _step, dummyM);
+	_stats = slic.GetIterationStats();
+	return numlabels;
+}
+
+const vector<SlicIterationStats>& SlicSegmenter::getIterationStats()
+{
+	return _stats;
+}
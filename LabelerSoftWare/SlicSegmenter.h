@@ -0,0 +1,29 @@
+/*SLICO superpixels behind the Segmenter interface*/
+#pragma once
+#include <vector>
+#include "Segmenter.h"
+#include "SLIC.h"
+using std::vector;
+class SlicScratchArena;
+
+class SlicSegmenter :public Segmenter
+{
+public:
+	explicit SlicSegmenter(int step);
+	virtual ~SlicSegmenter();
+public:
+	/*LAB planes and edges of the image to segment, shared by all scales; prepared on the fly when null or of another size*/
+	void setInput(shared_ptr<const SlicInputContext> input);
+	void setArena(SlicScratchArena* arena);//working buffers are taken from arena instead of the heap
+	void setIterationControl(int maxIterations, double tolerance);
+	virtual int segment(const Mat& bgr, Mat& labels);
+	virtual const char* name() const { return "SLIC"; }
+	const vector<SlicIterationStats>& getIterationStats();//of the last segment() call
+private:
+	int _step;
+	shared_ptr<const SlicInputContext> _input;
+	SlicScratchArena* _arena;
+	int _maxIterations;
+	double _tolerance;
+	vector<SlicIterationStats> _stats;
+};
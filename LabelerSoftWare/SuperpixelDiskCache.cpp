@@ -0,0 +1,296 @@
+#include "SuperpixelDiskCache.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QtConcurrent>
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+namespace
+{
+	/*bump when the file layout or the SLIC output for the same parameters changes*/
+	const quint32 SPCACHE_VERSION = 2;
+	const char SPCACHE_MAGIC[4] = { 'S', 'P', 'L', 'B' };
+	const qint64 VIDEO_HASH_BYTES = 1 << 20;//the video is identified by its size, time stamp and first megabyte
+	const int SPCACHE_COMPRESSION = 1;//zlib level, label images are long runs and shrink a lot even at the fastest level
+
+	struct SpCacheHeader
+	{
+		char magic[4];
+		quint32 version;
+		quint64 key;
+		qint32 width;
+		qint32 height;
+		qint32 bytesPerLabel;//2 when all labels fit in 16 bits, else 4
+		qint32 compressedBytes;//zlib payload (qCompress) after the header
+	};
+
+	bool olderUse(const QFileInfo& a, const QFileInfo& b)
+	{
+		return a.lastModified() < b.lastModified();
+	}
+}
+
+SuperpixelDiskCache::SuperpixelDiskCache()
+{
+	_enabled = false;
+	_key = 0;
+	_limitBytes = 0;
+	_usedBytes = 0;
+	_storing = false;
+}
+
+SuperpixelDiskCache::~SuperpixelDiskCache()
+{
+	waitForStores();
+}
+
+void SuperpixelDiskCache::configure(const QString& outputDir, const QString& videoPath, SegmentationControl::segmentationType type,
+	const SuperpixelScales& scales, bool hierarchical, int maxIterations, double tolerance, bool enabled, qint64 limitBytes)
+{
+	waitForStores();
+	_enabled = false;
+	_scales = scales;
+	_limitBytes = limitBytes;
+	if (!enabled || outputDir.isEmpty() || videoPath.isEmpty() || scales.empty() || limitBytes <= 0) return;
+	QByteArray videoHash = hashVideo(videoPath);
+	if (videoHash.isEmpty()) return;
+	/*out of the output directory, which is what gets delivered*/
+	QString cacheLocation = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	if (cacheLocation.isEmpty())
+		_root = QDir::cleanPath(outputDir) + ".spcache";
+	else
+		_root = QDir(cacheLocation).filePath("spcache");
+	_dir = QDir(_root).filePath(QString::fromLatin1(videoHash.toHex().left(16)));
+	if (!QDir().mkpath(_dir))
+	{
+		qDebug() << "superpixel cache disabled, cannot create" << _dir;
+		return;
+	}
+	/*hierarchical levels are merged from the finest scale, so every level depends on all scales*/
+	QString params = QString("v%1 type:%2 hierarchical:%3 iterations:%4 tolerance:%5 scales:")
+		.arg(SPCACHE_VERSION).arg(int(type)).arg(hierarchical ? 1 : 0).arg(maxIterations).arg(tolerance, 0, 'g', 17);
+	for (size_t i = 0; i < scales.size(); i++)
+	{
+		params += QString::number(scales[i]) + " ";
+	}
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	hash.addData(videoHash);
+	hash.addData(params.toLatin1());
+	QByteArray digest = hash.result();
+	memcpy(&_key, digest.constData(), sizeof(_key));
+	{
+		QMutexLocker locker(&_pruneLock);
+		prune();
+	}
+	_enabled = true;
+	qDebug() << "superpixel cache:" << _dir << params;
+}
+
+bool SuperpixelDiskCache::loadFrame(int frameIdx, vector<cv::Mat>& labels) const
+{
+	if (!_enabled) return false;
+	vector<cv::Mat> loaded(_scales.size());
+	for (size_t i = 0; i < _scales.size(); i++)
+	{
+		if (!load(filePath(frameIdx, _scales[i]), loaded[i])) return false;
+	}
+	for (size_t i = 0; i < _scales.size(); i++) touch(filePath(frameIdx, _scales[i]));
+	labels.swap(loaded);
+	return true;
+}
+
+void SuperpixelDiskCache::storeFrame(int frameIdx, const vector<cv::Mat>& labels) const
+{
+	if (!_enabled || labels.size() != _scales.size()) return;
+	qint64 written = 0;
+	for (size_t i = 0; i < _scales.size(); i++)
+	{
+		qint64 bytes = store(filePath(frameIdx, _scales[i]), labels[i]);
+		if (bytes == 0)
+			qDebug() << "cannot write superpixel cache" << filePath(frameIdx, _scales[i]);
+		written += bytes;
+	}
+	QMutexLocker locker(&_pruneLock);
+	_usedBytes += written;
+	if (_usedBytes > _limitBytes) prune();
+}
+
+void SuperpixelDiskCache::storeFrameLater(int frameIdx, const vector<cv::Mat>& labels)
+{
+	if (!_enabled || labels.size() != _scales.size()) return;
+	QMutexLocker locker(&_storeLock);
+	_pendingStores.push_back(std::make_pair(frameIdx, labels));
+	if (!_storing)
+	{
+		_storing = true;
+		_storeWorker = QtConcurrent::run(this, &SuperpixelDiskCache::runStores);
+	}
+}
+
+void SuperpixelDiskCache::waitForStores()
+{
+	_storeWorker.waitForFinished();
+}
+
+void SuperpixelDiskCache::runStores()
+{
+	while (true)
+	{
+		std::pair<int, vector<cv::Mat> > frame;
+		{
+			QMutexLocker locker(&_storeLock);
+			if (_pendingStores.empty())
+			{
+				_storing = false;
+				return;
+			}
+			frame = _pendingStores.front();
+			_pendingStores.pop_front();
+		}
+		storeFrame(frame.first, frame.second);
+	}
+}
+
+QString SuperpixelDiskCache::filePath(int frameIdx, int step) const
+{
+	return QDir(_dir).filePath(QString("frame%1_step%2.splabel").arg(frameIdx, 6, 10, QChar('0')).arg(step));
+}
+
+bool SuperpixelDiskCache::load(const QString& path, cv::Mat& labels) const
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) return false;
+	const qint64 size = file.size();
+	if (size < qint64(sizeof(SpCacheHeader))) return false;
+	uchar* data = file.map(0, size);
+	if (data == NULL) return false;
+	SpCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+	const qint64 pixels = qint64(header.width)*header.height;
+	bool valid = memcmp(header.magic, SPCACHE_MAGIC, sizeof(SPCACHE_MAGIC)) == 0 && header.version == SPCACHE_VERSION
+		&& header.key == _key && header.width > 0 && header.height > 0
+		&& (header.bytesPerLabel == 2 || header.bytesPerLabel == 4)
+		&& size == qint64(sizeof(SpCacheHeader)) + header.compressedBytes;
+	QByteArray plain;
+	if (valid)
+	{
+		plain = qUncompress(data + sizeof(SpCacheHeader), header.compressedBytes);
+		valid = plain.size() == pixels*header.bytesPerLabel;
+	}
+	if (valid)
+	{
+		labels.create(header.height, header.width, CV_32S);
+		const uchar* payload = (const uchar*)plain.constData();
+		if (header.bytesPerLabel == 4)
+		{
+			memcpy(labels.data, payload, size_t(pixels) * 4);
+		}
+		else
+		{
+			const quint16* src = (const quint16*)payload;
+			int* dst = (int*)labels.data;
+			for (qint64 i = 0; i < pixels; i++) dst[i] = src[i];
+		}
+	}
+	file.unmap(data);
+	return valid;
+}
+
+qint64 SuperpixelDiskCache::store(const QString& path, const cv::Mat& labels) const
+{
+	if (labels.empty() || labels.type() != CV_32S || !labels.isContinuous()) return 0;
+	const qint64 pixels = qint64(labels.cols)*labels.rows;
+	const int* src = (const int*)labels.data;
+	int minLabel = 0, maxLabel = 0;
+	for (qint64 i = 0; i < pixels; i++)
+	{
+		if (src[i] > maxLabel) maxLabel = src[i];
+		if (src[i] < minLabel) minLabel = src[i];
+	}
+	SpCacheHeader header;
+	memcpy(header.magic, SPCACHE_MAGIC, sizeof(SPCACHE_MAGIC));
+	header.version = SPCACHE_VERSION;
+	header.key = _key;
+	header.width = labels.cols;
+	header.height = labels.rows;
+	header.bytesPerLabel = minLabel >= 0 && maxLabel <= 0xffff ? 2 : 4;
+	QByteArray payload;
+	if (header.bytesPerLabel == 4)
+	{
+		payload = qCompress((const uchar*)src, int(pixels * 4), SPCACHE_COMPRESSION);
+	}
+	else
+	{
+		vector<quint16> packed(size_t(pixels));
+		for (qint64 i = 0; i < pixels; i++) packed[size_t(i)] = quint16(src[i]);
+		payload = qCompress((const uchar*)packed.data(), int(pixels * 2), SPCACHE_COMPRESSION);
+	}
+	header.compressedBytes = payload.size();
+
+	/*written to a temporary file and renamed, a reader never sees half a file*/
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) return 0;
+	file.write((const char*)&header, sizeof(header));
+	file.write(payload);
+	if (!file.commit()) return 0;
+	return qint64(sizeof(header)) + payload.size();
+}
+
+void SuperpixelDiskCache::prune() const
+{
+	/*a file is used when it is written or read (see touch), the oldest go first*/
+	vector<QFileInfo> files;
+	qint64 total = 0;
+	QDirIterator it(_root, QStringList() << "*.splabel", QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext())
+	{
+		it.next();
+		files.push_back(it.fileInfo());
+		total += files.back().size();
+	}
+	if (total > _limitBytes)
+	{
+		std::sort(files.begin(), files.end(), olderUse);
+		const qint64 target = _limitBytes / 4 * 3;
+		for (size_t i = 0; i < files.size() && total > target; i++)
+		{
+			if (QFile::remove(files[i].filePath())) total -= files[i].size();
+		}
+		qDebug() << "superpixel cache pruned to" << (total >> 20) << "MB";
+	}
+	_usedBytes = total;
+}
+
+void SuperpixelDiskCache::touch(const QString& path)
+{
+#ifdef _WIN32
+	_wutime((const wchar_t*)path.utf16(), NULL);
+#else
+	utime(QFile::encodeName(path).constData(), NULL);
+#endif
+}
+
+QByteArray SuperpixelDiskCache::hashVideo(const QString& videoPath)
+{
+	QFileInfo info(videoPath);
+	QFile file(videoPath);
+	if (!info.exists() || !file.open(QIODevice::ReadOnly)) return QByteArray();
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	hash.addData(QByteArray::number(info.size()));
+	hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+	hash.addData(file.read(VIDEO_HASH_BYTES));
+	return hash.result();
+}
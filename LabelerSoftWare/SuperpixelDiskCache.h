@@ -0,0 +1,59 @@
+/*Superpixel label images of visited frames kept in the user cache directory, so revisiting a frame reads a file instead of segmenting*/
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <QFuture>
+#include <deque>
+#include <utility>
+#include <vector>
+#include <opencv.hpp>
+#include "DataType.h"
+#include "SegmentationControl.h"
+using std::vector;
+
+class SuperpixelDiskCache
+{
+public:
+	SuperpixelDiskCache();
+	~SuperpixelDiskCache();
+public:
+	/*
+	Files go to <cache location>/spcache/<hash of the video>, one per frame and scale, or next
+	to outputDir (<outputDir>.spcache) when the system has no cache location.
+	Every file carries a key of the video and of the segmentation parameters; a file written
+	with other parameters (or by another version of the format) is ignored and
+	overwritten on the next store. enabled = false turns load and store into no-ops.
+	Beyond limitBytes for all videos, the files read or written least recently are deleted.
+	*/
+	void configure(const QString& outputDir, const QString& videoPath, SegmentationControl::segmentationType type,
+		const SuperpixelScales& scales, bool hierarchical, int maxIterations, double tolerance, bool enabled, qint64 limitBytes);
+	/*label images (CV_32S) of all scales of frameIdx, false if any of them is missing or stale; labels is only set on success*/
+	bool loadFrame(int frameIdx, vector<cv::Mat>& labels) const;
+	/*labels in the order of the configured scales*/
+	void storeFrame(int frameIdx, const vector<cv::Mat>& labels) const;
+	/*storeFrame on a worker thread, for callers on the GUI thread; frames are written in the order they come*/
+	void storeFrameLater(int frameIdx, const vector<cv::Mat>& labels);
+	void waitForStores();
+private:
+	void runStores();
+	QString filePath(int frameIdx, int step) const;
+	bool load(const QString& path, cv::Mat& labels) const;
+	qint64 store(const QString& path, const cv::Mat& labels) const;//bytes written, 0 on failure
+	void prune() const;//delete the least recently used files down to 3/4 of the limit
+	static void touch(const QString& path);//mark the file as used now
+	static QByteArray hashVideo(const QString& videoPath);
+private:
+	bool _enabled;
+	QString _root;//shared by all videos, pruned as a whole
+	QString _dir;
+	SuperpixelScales _scales;
+	quint64 _key;
+	qint64 _limitBytes;
+	mutable QMutex _pruneLock;//stores come from the precompute worker and the store worker
+	mutable qint64 _usedBytes;//estimate, exact after every prune
+	QMutex _storeLock;//guards the store queue
+	std::deque<std::pair<int, vector<cv::Mat> > > _pendingStores;
+	bool _storing;
+	QFuture<void> _storeWorker;
+};
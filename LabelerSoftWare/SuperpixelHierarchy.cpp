@@ -0,0 +1,176 @@
+#include "SuperpixelHierarchy.h"
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <exception>
+
+namespace
+{
+	struct RegionStats
+	{
+		double count;
+		double suml;
+		double suma;
+		double sumb;
+	};
+
+	struct MergeCandidate
+	{
+		double cost;
+		int a;
+		int b;
+		int stampA;
+		int stampB;
+		bool operator>(const MergeCandidate& o) const
+		{
+			if (cost != o.cost) return cost > o.cost;
+			if (a != o.a) return a > o.a;
+			return b > o.b;
+		}
+	};
+
+	int findRoot(vector<int>& parent, int x)
+	{
+		while (parent[x] != x)
+		{
+			parent[x] = parent[parent[x]];
+			x = parent[x];
+		}
+		return x;
+	}
+
+	double mergeCost(const RegionStats& p, const RegionStats& q)
+	{
+		double dl = p.suml / p.count - q.suml / q.count;
+		double da = p.suma / p.count - q.suma / q.count;
+		double db = p.sumb / p.count - q.sumb / q.count;
+		return p.count*q.count / (p.count + q.count)*(dl*dl + da*da + db*db);
+	}
+}
+
+SuperpixelHierarchy::SuperpixelHierarchy()
+{
+}
+
+void SuperpixelHierarchy::buildLevels(
+	const SlicInputContext&		input,
+	const int*					fineLabels,
+	int							numFineLabels,
+	const vector<int>&			targetCounts,
+	vector<vector<int> >&		levelLabels)
+{
+	const int width = input.width;
+	const int height = input.height;
+	const int sz = width*height;
+	if (numFineLabels <= 0 || sz == 0) throw std::exception("no superpixels to merge");
+
+	/*region colour statistics*/
+	vector<RegionStats> stats(numFineLabels);
+	for (int k = 0; k < numFineLabels; k++)
+	{
+		RegionStats s = { 0, 0, 0, 0 };
+		stats[k] = s;
+	}
+	for (int i = 0; i < sz; i++)
+	{
+		RegionStats& s = stats[fineLabels[i]];
+		s.count += 1;
+		s.suml += input.lvec[i];
+		s.suma += input.avec[i];
+		s.sumb += input.bvec[i];
+	}
+
+	/*region adjacency graph from 4-neighbourhood*/
+	vector<vector<int> > neighbours(numFineLabels);
+	for (int y = 0; y < height; y++)
+	{
+		const int* row = fineLabels + y*width;
+		for (int x = 0; x < width; x++)
+		{
+			int l = row[x];
+			if (x + 1 < width && row[x + 1] != l)
+			{
+				neighbours[l].push_back(row[x + 1]);
+				neighbours[row[x + 1]].push_back(l);
+			}
+			if (y + 1 < height && row[x + width] != l)
+			{
+				neighbours[l].push_back(row[x + width]);
+				neighbours[row[x + width]].push_back(l);
+			}
+		}
+	}
+	std::priority_queue<MergeCandidate, vector<MergeCandidate>, std::greater<MergeCandidate> > heap;
+	vector<int> stamp(numFineLabels, 0);
+	for (int k = 0; k < numFineLabels; k++)
+	{
+		vector<int>& nb = neighbours[k];
+		std::sort(nb.begin(), nb.end());
+		nb.erase(std::unique(nb.begin(), nb.end()), nb.end());
+		for (size_t j = 0; j < nb.size(); j++)
+		{
+			if (nb[j] <= k) continue;
+			MergeCandidate c = { mergeCost(stats[k], stats[nb[j]]), k, nb[j], 0, 0 };
+			heap.push(c);
+		}
+	}
+
+	/*coarsest level last, so that each snapshot only needs more merges*/
+	vector<int> order(targetCounts.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = int(i);
+	std::sort(order.begin(), order.end(), [&targetCounts](int p, int q) { return targetCounts[p] > targetCounts[q]; });
+
+	vector<int> parent(numFineLabels);
+	for (int k = 0; k < numFineLabels; k++) parent[k] = k;
+	int numRegions = numFineLabels;
+	levelLabels.assign(targetCounts.size(), vector<int>());
+	vector<int> compact(numFineLabels);
+	for (size_t o = 0; o < order.size(); o++)
+	{
+		const int target = std::max<int>(1, targetCounts[order[o]]);
+		while (numRegions > target && !heap.empty())
+		{
+			MergeCandidate c = heap.top();
+			heap.pop();
+			if (stamp[c.a] != c.stampA || stamp[c.b] != c.stampB) continue;//one side merged since
+			if (parent[c.a] != c.a || parent[c.b] != c.b) continue;
+
+			/*merge b into a*/
+			int a = c.a, b = c.b;
+			parent[b] = a;
+			stats[a].count += stats[b].count;
+			stats[a].suml += stats[b].suml;
+			stats[a].suma += stats[b].suma;
+			stats[a].sumb += stats[b].sumb;
+			stamp[a]++;
+			numRegions--;
+
+			vector<int>& nb = neighbours[a];
+			nb.insert(nb.end(), neighbours[b].begin(), neighbours[b].end());
+			vector<int>().swap(neighbours[b]);
+			for (size_t j = 0; j < nb.size(); j++) nb[j] = findRoot(parent, nb[j]);
+			std::sort(nb.begin(), nb.end());
+			nb.erase(std::unique(nb.begin(), nb.end()), nb.end());
+			nb.erase(std::remove(nb.begin(), nb.end(), a), nb.end());
+			for (size_t j = 0; j < nb.size(); j++)
+			{
+				int n = nb[j];
+				int p = std::min(a, n), q = std::max(a, n);
+				MergeCandidate m = { mergeCost(stats[p], stats[q]), p, q, stamp[p], stamp[q] };
+				heap.push(m);
+			}
+		}
+
+		/*snapshot, regions numbered in raster order of their first pixel*/
+		compact.assign(numFineLabels, -1);
+		vector<int>& out = levelLabels[order[o]];
+		out.resize(sz);
+		int next = 0;
+		for (int i = 0; i < sz; i++)
+		{
+			int r = findRoot(parent, fineLabels[i]);
+			if (compact[r] < 0) compact[r] = next++;
+			out[i] = compact[r];
+		}
+	}
+}
@@ -0,0 +1,26 @@
+/*Coarser superpixel levels built by merging adjacent fine SLIC superpixels*/
+#pragma once
+#include <vector>
+#include "SLIC.h"
+using std::vector;
+
+class SuperpixelHierarchy
+{
+public:
+	/*
+	Greedily merges adjacent regions of the fine labeling on a region adjacency graph,
+	cheapest pair first. The cost of a pair is the Ward increase of the LAB variance,
+	n1*n2/(n1+n2)*|mean1-mean2|^2, so small and similar regions go first.
+	One labeling is written per entry of targetCounts (any order), each relabeled to
+	0..n-1 in raster order. Every coarse segment is a union of fine segments and of
+	the segments of all finer levels, so the levels nest exactly.
+	*/
+	static void buildLevels(
+		const SlicInputContext&		input,
+		const int*					fineLabels,
+		int							numFineLabels,
+		const vector<int>&			targetCounts,
+		vector<vector<int> >&		levelLabels);
+private:
+	SuperpixelHierarchy();
+};
@@ -0,0 +1,191 @@
+#include "SuperpixelPrecompute.h"
+#include <QMutexLocker>
+#include <QtConcurrent>
+#include <QDebug>
+#include <set>
+#include <cstdlib>
+#include "SegmentationControl.h"
+#include "SlicScratchArena.h"
+#include "SuperpixelDiskCache.h"
+
+SuperpixelPrecompute::SuperpixelPrecompute()
+{
+	_running = false;
+	_stopping = false;
+	_anchor = 0;
+	_type = SegmentationControl::SLIC_;
+	_hierarchical = false;
+	_maxIterations = 10;
+	_tolerance = 0;
+	_frames = 0;
+	_arena = NULL;
+	_diskCache = NULL;
+}
+
+SuperpixelPrecompute::~SuperpixelPrecompute()
+{
+	stop();
+}
+
+void SuperpixelPrecompute::configure(const QString& videoPath, SegmentationControl::segmentationType type, const SuperpixelScales& scales, bool hierarchical,
+	int maxIterations, double tolerance, int frames, SlicScratchArena* arena, const SuperpixelDiskCache* diskCache)
+{
+	stop();
+	QMutexLocker locker(&_lock);
+	_videoPath = videoPath;
+	_type = type;
+	_scales = scales;
+	_hierarchical = hierarchical;
+	_maxIterations = maxIterations;
+	_tolerance = tolerance;
+	_frames = frames;
+	_arena = arena;
+	_diskCache = diskCache;
+	_cache.clear();
+	_stopping = false;
+	if (_capture.isOpened()) _capture.release();
+}
+
+void SuperpixelPrecompute::schedule(int frameIdx, int interval)
+{
+	QMutexLocker locker(&_lock);
+	if (_frames <= 0 || _videoPath.isEmpty() || _scales.empty() || _stopping) return;
+	interval = std::max(1, interval);
+	_anchor = frameIdx;
+	_queue.clear();
+	for (int k = 1; k <= _frames; k++)
+	{
+		int idx = frameIdx + k*interval;
+		if (_cache.count(std::make_pair(idx, _scales[0])) == 0) _queue.push_back(idx);
+	}
+	evict();
+	if (!_running && !_queue.empty())
+	{
+		_running = true;
+		_worker = QtConcurrent::run(this, &SuperpixelPrecompute::run);
+	}
+}
+
+bool SuperpixelPrecompute::fetch(int frameIdx, vector<cv::Mat>& labels)
+{
+	QMutexLocker locker(&_lock);
+	if (_scales.empty()) return false;
+	vector<cv::Mat> found(_scales.size());
+	for (size_t i = 0; i < _scales.size(); i++)
+	{
+		std::map<std::pair<int, int>, cv::Mat>::const_iterator it = _cache.find(std::make_pair(frameIdx, _scales[i]));
+		if (it == _cache.end()) return false;
+		found[i] = it->second;
+	}
+	labels.swap(found);
+	return true;
+}
+
+void SuperpixelPrecompute::stop()
+{
+	{
+		QMutexLocker locker(&_lock);
+		_stopping = true;
+		_queue.clear();
+	}
+	_worker.waitForFinished();
+}
+
+void SuperpixelPrecompute::run()
+{
+	while (true)
+	{
+		int frameIdx = 0;
+		{
+			QMutexLocker locker(&_lock);
+			if (_stopping || _queue.empty())
+			{
+				_running = false;
+				return;
+			}
+			frameIdx = _queue.front();
+			_queue.pop_front();
+		}
+		vector<cv::Mat> labels;
+		bool done = false;
+		try
+		{
+			done = segmentFrame(frameIdx, labels);
+		}
+		catch (std::exception& e)
+		{
+			qDebug() << "superpixel precomputation of frame" << frameIdx << "failed:" << e.what();
+		}
+		if (!done) continue;
+		QMutexLocker locker(&_lock);
+		for (size_t i = 0; i < labels.size(); i++)
+		{
+			_cache[std::make_pair(frameIdx, _scales[i])] = labels[i];
+		}
+		evict();
+		qDebug() << "superpixels of frame" << frameIdx << "precomputed";
+	}
+}
+
+bool SuperpixelPrecompute::segmentFrame(int frameIdx, vector<cv::Mat>& labels)
+{
+	if (_diskCache && _diskCache->loadFrame(frameIdx, labels)) return true;
+	if (!_capture.isOpened() && !_capture.open(_videoPath.toStdString())) return false;
+	cv::Mat frame;
+	_capture.set(cv::CAP_PROP_POS_FRAMES, frameIdx);
+	if (!_capture.read(frame) || frame.empty()) return false;
+
+	/*same setup as LabelingTaskControl, without the temporal warm start*/
+	PtrSharedSlicInput slicInput(new SharedSlicInput(frame, _arena));
+	vector<SegmentationControl*> controls;
+	for (size_t i = 0; i < _scales.size(); i++)
+	{
+		SegmentationControl* ctrl = new SegmentationControl(frame, _scales[i], slicInput);
+		ctrl->setSlicArena(_arena);
+		ctrl->setSlicIterationControl(_maxIterations, _tolerance);
+		controls.push_back(ctrl);
+	}
+	if (_hierarchical)
+	{
+		SegmentationControl::doHierarchicalSlicSegmentation(controls);
+	}
+	else
+	{
+		for (size_t i = 0; i < controls.size(); i++)
+		{
+			controls[i]->processBackgroundSegmentation(_type);
+		}
+	}
+	labels.resize(controls.size());
+	for (size_t i = 0; i < controls.size(); i++)
+	{
+		labels[i] = controls[i]->getLabelImage();
+		delete controls[i];
+	}
+	if (_diskCache) _diskCache->storeFrame(frameIdx, labels);
+	return true;
+}
+
+void SuperpixelPrecompute::evict()
+{
+	/*room for the labeled frame, the frames ahead and the one labeled before*/
+	const size_t capacity = size_t(_frames) + 2;
+	std::set<int> frames;
+	for (std::map<std::pair<int, int>, cv::Mat>::const_iterator it = _cache.begin(); it != _cache.end(); ++it)
+	{
+		frames.insert(it->first.first);
+	}
+	while (frames.size() > capacity)
+	{
+		std::set<int>::iterator farthest = frames.begin();
+		for (std::set<int>::iterator it = frames.begin(); it != frames.end(); ++it)
+		{
+			if (std::abs(*it - _anchor) > std::abs(*farthest - _anchor)) farthest = it;
+		}
+		for (size_t i = 0; i < _scales.size(); i++)
+		{
+			_cache.erase(std::make_pair(*farthest, _scales[i]));
+		}
+		frames.erase(farthest);
+	}
+}
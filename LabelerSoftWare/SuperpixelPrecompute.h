@@ -0,0 +1,57 @@
+/*Segments the frames coming up on the labeling interval in the background, so that superpixel mode opens without waiting*/
+#pragma once
+#include <QMutex>
+#include <QFuture>
+#include <QString>
+#include <map>
+#include <deque>
+#include <utility>
+#include <vector>
+#include <opencv.hpp>
+#include "DataType.h"
+#include "SegmentationControl.h"
+using std::vector;
+class SlicScratchArena;
+class SuperpixelDiskCache;
+
+class SuperpixelPrecompute
+{
+public:
+	SuperpixelPrecompute();
+	~SuperpixelPrecompute();
+public:
+	/*
+	frames: how many frames after the labeled one are segmented ahead, 0 disables
+	precomputation. The video is read through a capture of its own. Frames found in
+	diskCache are loaded from it, the others are stored to it once segmented.
+	*/
+	void configure(const QString& videoPath, SegmentationControl::segmentationType type, const SuperpixelScales& scales, bool hierarchical,
+		int maxIterations, double tolerance, int frames, SlicScratchArena* arena, const SuperpixelDiskCache* diskCache = NULL);
+	/*frameIdx is opened for labeling: segment the next frames on the interval, queued work for other frames is dropped*/
+	void schedule(int frameIdx, int interval);
+	/*label images (CV_32S) of all scales of frameIdx, false if they are not ready; labels is only set on success*/
+	bool fetch(int frameIdx, vector<cv::Mat>& labels);
+	void stop();//drop queued frames and wait for the one being segmented
+private:
+	void run();
+	bool segmentFrame(int frameIdx, vector<cv::Mat>& labels);
+	void evict();//keep the frames closest to _anchor
+private:
+	QMutex _lock;
+	QFuture<void> _worker;
+	bool _running;
+	bool _stopping;
+	std::deque<int> _queue;
+	std::map<std::pair<int, int>, cv::Mat> _cache;//(frame, scale) -> labels
+	int _anchor;
+	cv::VideoCapture _capture;//used by the worker only
+	QString _videoPath;
+	SegmentationControl::segmentationType _type;
+	SuperpixelScales _scales;
+	bool _hierarchical;
+	int _maxIterations;
+	double _tolerance;
+	int _frames;
+	SlicScratchArena* _arena;
+	const SuperpixelDiskCache* _diskCache;
+};
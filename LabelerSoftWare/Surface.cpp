@@ -5,6 +5,7 @@
 #include <QRect>
 #include <qmessagebox.h>
 #include <OpencvUtils.h>
+#include <cmath>
 
 //#define CHECK_QIMAGE
 using CV_Utils::trimRect;
@@ -16,11 +17,15 @@ using CV_Utils::trimRect;
 QColor Surface::_myPenColor(0, 0, 0);
 int Surface::_myPenRadius = 10;
 
-Surface::Surface(const QImage& Img, QWidget*parent) :QLabel(parent), _blendImage(Img.height(), Img.width(), CV_8UC3), _oriImage(&Img)
+Surface::Surface(const QImage& Img, QWidget*parent) :QLabel(parent), _oriImage(&Img)
 {
 	//labelImg() = Mat(400, 400, CV_8UC3);//TODO labelImg should be replace
 	//_ImageDraw = ImageConversion::cvMat_to_QImage(labelImg());
 	_drawType = PIXEL_WISE;
+	_view = VIEW_ORIGINAL;
+	_scaleRatio = 1.0;
+	_referenceImage = nullptr;
+	_referenceOriginalImage = nullptr;
 	setOriginalImage(Img);
 	this->setMouseTracking(true);
 	_bUpdateClipMat = false;
@@ -41,6 +46,8 @@ Surface::Surface(const QImage& Img, QWidget*parent) :QLabel(parent), _blendImage
 	blendAlphaSource = 0.5;
 	blendAlphaReference = 0.5;
 	_seg_drawn_num = 0;
+	_segIndex = NULL;
+	_strokeGeneration = 1;
 	_timePoint = steady_clock::now();
 	fitSizeToImage();
 }
@@ -54,6 +61,7 @@ Surface::~Surface()
 
 QImage Surface::getImage()
 {
+	ensureTiles(_ImageDraw.rect());
 	return this->_ImageDraw;
 }
 
@@ -64,6 +72,7 @@ const QImage& Surface::getOriImage()
 
 QImage Surface::getImageCpy()
 {
+	ensureTiles(_ImageDraw.rect());
 	return this->_ImageDraw.copy();
 }
 
@@ -93,7 +102,7 @@ void Surface::setEditable(bool b)
 {
 	_bEdit = b;
 	setCursorInvisible(b);
-	_ImageDraw = _oriImage->copy();
+	bindDrawImage();
 }
 void Surface::startLabel()
 {
@@ -118,14 +127,8 @@ bool Surface::isEditable()
 void Surface::setOriginalImage(const QImage& pOriginal)
 {
 	_oriImage = &pOriginal;
-	if (isEditable())
-	{
-		_ImageDraw = _oriImage->copy();
-	}
-	else
-	{
-		_ImageDraw = *_oriImage;
-	}
+	_tiles.reset(_oriImage->width(), _oriImage->height(), _oriImage->format());
+	bindDrawImage();
 	//this->setPixmap(QPixmap::fromImage(_ImageDraw));
 }
 
@@ -137,11 +140,13 @@ void Surface::setScrollArea(QScrollArea* pScrollArea)
 void Surface::setReferenceImage(const QImage* pReference)
 {
 	_referenceImage = pReference;
+	if (_view != VIEW_ORIGINAL) _tiles.invalidate();
 }
 
 void Surface::setReferenceOriginalImage(const QImage* pReference)
 {
 	_referenceOriginalImage = pReference;
+	if (_view != VIEW_ORIGINAL) _tiles.invalidate();
 }
 
 void Surface::changeClass(QString txt, QColor clr)
@@ -165,39 +170,7 @@ void Surface::showScaled()
 {
 	//this->updateScaleRatioByRank();
 	this->applyScaleRatio();
-	_ImageDraw = _scaledOriImage.copy();
-	update();
-}
-
-void Surface::showScaledRefImg(const QImage* Img, cv::Rect rect)
-{
-	if (!rect.empty())
-	{
-		cv::Rect scaledRect;
-		scaledRect.x = rect.x*_scaleRatio + 0.5;
-		scaledRect.y = rect.y*_scaleRatio + 0.5;
-		scaledRect.height = rect.height*_scaleRatio;
-		scaledRect.width = rect.width*_scaleRatio;
-		scaledRect = trimRect(scaledRect, 0, 0, _ImageDraw.width(), _ImageDraw.height());
-		Mat mRectImage, mResize;
-		Mat(ImageConversion::QImage_to_cvMat(*Img, false), rect).copyTo(mRectImage);
-		Mat mDrawImage = ImageConversion::QImage_to_cvMat(_ImageDraw, false);
-		cv::resize(mRectImage, mResize, cv::Size(scaledRect.width, scaledRect.height),0,0, cv::INTER_NEAREST);
-		mResize.copyTo(Mat(mDrawImage, scaledRect));
-	}
-	else
-	{
-		if (!_oriImage->isNull() && _scaleRatio != 1.0)
-		{
-			int width = _oriImage->width()*_scaleRatio;
-			int height = _oriImage->height()*_scaleRatio;
-			width = width < 1 ? 1 : width;
-			height = height < 1 ? 1 : height;
-			_ImageDraw = Img->scaled(QSize(width, height), Qt::AspectRatioMode::KeepAspectRatioByExpanding);
-		}
-		else
-			_ImageDraw = Img->copy();
-	}
+	setView(VIEW_ORIGINAL);
 	update();
 }
 
@@ -206,20 +179,8 @@ void Surface::showReferenceImg()
 	if (_referenceImage)
 	{
 		qDebug() << "showReferenceImg";
-    if (_drawType == DRAW_TYPE::PIXEL_WISE)
-    {
-      QImage img;
-      img = blendImage(*_oriImage, blendAlphaSource, *_referenceImage, blendAlphaReference);
-      showScaledRefImg(&img);
-    }
-    else if(_drawType==DRAW_TYPE::SUPER_PIXEL_WISE)
-    {
-      QImage img;
-      img = blendImage(*_oriImage, blendAlphaSource, *_referenceOriginalImage, blendAlphaReference);
-      img = blendImage(img, blendAlphaSource, *_referenceImage, blendAlphaReference);
-      showScaledRefImg(&img);
-    }
-		//showScaledRefImg(_referenceImage); ??please uncomment this to restore
+		setView(VIEW_REFERENCE);
+		update();
 	}
 	else
 	{
@@ -232,21 +193,8 @@ void Surface::updateShowReferenceImg(cv::Rect rect)
 {
 	if (_referenceImage)
 	{
-    qDebug() << "To showScaledRefImg";
-    if (_drawType == DRAW_TYPE::PIXEL_WISE)
-    {
-      QImage img;
-      img = blendImage(*_oriImage, blendAlphaSource, *_referenceImage, blendAlphaReference, rect);
-      showScaledRefImg(&img, rect);
-    }
-    else if (_drawType == DRAW_TYPE::SUPER_PIXEL_WISE)
-    {
-      QImage img;
-      img = blendImage(*_oriImage, blendAlphaSource, *_referenceOriginalImage, blendAlphaReference,rect);
-      img = blendImage(img, blendAlphaSource, *_referenceImage, blendAlphaReference,rect);
-      showScaledRefImg(&img,rect);
-    }
-		//showScaledRefImg(_referenceImage); ??please uncomment this to restore
+		_tiles.invalidate(rect);
+		update();
 	}
 	else
 	{
@@ -260,8 +208,8 @@ void Surface::showReferenceOriginalImg()
 {
 	if (_referenceOriginalImage)
 	{
-		showScaledRefImg(_referenceOriginalImage);
-		//showScaledRefImg(_referenceImage); ??please uncomment this to restore
+		setView(VIEW_REFERENCE_ORIGINAL);
+		update();
 	}
 	else
 	{
@@ -345,6 +293,7 @@ void Surface::keyPressEvent(QKeyEvent *ev)
 
 				r = cv::boundingRect(vecPts);
 				vecPts = transformVecPtsByScaleAndPos(vecPts, 1.0, -r.tl());
+				ensureTiles(QRect(r.x, r.y, r.width, r.height));
 				Mat& drawIMG = ImageConversion::QImage_to_cvMat(_ImageDraw, false);
 				Mat(drawIMG, r).copyTo(_drawClipMat);
 				drawPolytonToMat(vecPts, _drawClipMat);
@@ -400,6 +349,7 @@ void Surface::paintEvent(QPaintEvent *ev)
 
 	/* draw background image */
 	QRect dirtyRect = ev->rect();
+	ensureTiles(dirtyRect);
 	painter.drawImage(dirtyRect, _ImageDraw, dirtyRect);
 	//qDebug() << "dirtyRect:" << dirtyRect;
 
@@ -471,8 +421,7 @@ void Surface::mousePressEvent(QMouseEvent *ev)
 						QPoint center = ev->pos();
 						center /= _scaleRatio;
 						//qDebug() << center;
-						setVecPointsWithinRadiusOfPoint(_vecPtsToEmit, _circleInnerPoint, Point(center.x(), center.y()), _oriImage->width(), _oriImage->height());
-						emit signalPixelCovered(&_vecPtsToEmit);
+						emit signalBrushMoved(center.x(), center.y(), getBrushRadiusInImage());
 					}
 				}
 			}
@@ -556,8 +505,7 @@ void Surface::mouseMoveEvent(QMouseEvent *ev)
 				QPoint center = ev->pos();
 				center /= _scaleRatio;
 				//qDebug() << center;
-				setVecPointsWithinRadiusOfPoint(_vecPtsToEmit, _circleInnerPoint, Point(center.x(), center.y()), _oriImage->width(), _oriImage->height());
-				emit signalPixelCovered(&_vecPtsToEmit);
+				emit signalBrushMoved(center.x(), center.y(), getBrushRadiusInImage());
 			}
 		}
 		else
@@ -573,6 +521,7 @@ void Surface::mouseMoveEvent(QMouseEvent *ev)
 
 				r = cv::boundingRect(vecPts);
 				vecPts = transformVecPtsByScaleAndPos(vecPts, 1.0, -r.tl());
+				ensureTiles(QRect(r.x, r.y, r.width, r.height));
 				Mat& drawIMG = ImageConversion::QImage_to_cvMat(_ImageDraw, false);
 				Mat(drawIMG, r).copyTo(_drawClipMat);
 				drawPolytonToMat(vecPts, _drawClipMat);
@@ -612,7 +561,7 @@ void Surface::mouseReleaseEvent(QMouseEvent *ev)
 					if (_bLButtonDown/*&&_drawType == DRAW_TYPE::SUPER_PIXEL_WISE*/)
 					{
 						qDebug() << "emit signalDrawPixelsToResult";
-						emit signalDrawPixelsToResult(&_tempVecSegs, _myPenColor);
+						emit signalDrawPixelsToResult(_segIndex, &_tempVecSegs, _myPenColor);
 					}
 					if (_bShowRef)
 					{
@@ -621,10 +570,7 @@ void Surface::mouseReleaseEvent(QMouseEvent *ev)
 							_savedBoundingRect.width / _scaleRatio, _savedBoundingRect.height / _scaleRatio);
 						updateShowReferenceImg(r);
 					}
-					_tempVecSegs.clear();
-					_tempVecPoint.clear();
-					_seg_drawn_num = 0;
-					_drawClipMat = Mat();
+					clearStroke();
 					_bUpdateClipMat = false;
 					_bLButtonDown = false;
 				}
@@ -817,10 +763,16 @@ void Surface::updateImage(cv::Rect rect)
 #ifdef CHECK_QIMAGE
 	qt_debug::showQImage(_oriImage);
 #endif //CHECK_QIMAGE 
-	if (!rect.empty() && !_scaledOriImage.isNull() && _scaledOriImage.size() == _ImageDraw.size())
-		updateRectOfImg(rect);
+	if (!rect.empty())
+	{
+		_tiles.invalidate(rect);
+		bindDrawImage();//the original may have been reassigned
+	}
 	else
+	{
+		_tiles.invalidate();
 		applyScaleRatio();
+	}
 			
 }
 
@@ -957,45 +909,67 @@ void Surface::updateScaleRatioByRank()
 
 void Surface::applyScaleRatio()
 {
-	if (!_oriImage->isNull() && _scaleRatio != 1.0)
+	setView(_bShowRef ? VIEW_REFERENCE : VIEW_ORIGINAL);
+	bindDrawImage();
+	//qDebug() << "applyScaleRatio";
+}
+
+void Surface::setView(VIEW_TYPE view)
+{
+	if (view != _view)
 	{
-		int width = _oriImage->width()*_scaleRatio;
-		int height = _oriImage->height()*_scaleRatio;
-		width = width < 1 ? 1 : width;
-		height = height < 1 ? 1 : height;
-		_scaledOriImage = _oriImage->scaled(QSize(width, height), Qt::AspectRatioMode::KeepAspectRatioByExpanding);
+		_tiles.invalidate();
+		_view = view;
 	}
+	bindDrawImage();
+}
+
+void Surface::bindDrawImage()
+{
+	if (_oriImage->isNull() || (_view == VIEW_ORIGINAL && _scaleRatio == 1.0))
+		_ImageDraw = *_oriImage;
 	else
-		_scaledOriImage = _oriImage->copy();
-	if (_bShowRef)
-		showReferenceImg();
-	else
-		_ImageDraw = _scaledOriImage.copy();
-	//qDebug() << "applyScaleRatio";
+		_ImageDraw = _tiles.level(_scaleRatio);
 }
 
-void Surface::updateRectOfImg(cv::Rect rect)
-{
-	qDebug() << "To updateRectOfImg";
-	cv::Rect scaledRect;
-	scaledRect.x = rect.x*_scaleRatio + 0.5;
-	scaledRect.y = rect.y*_scaleRatio + 0.5;
-	scaledRect.height = rect.height*_scaleRatio;
-	scaledRect.width = rect.width*_scaleRatio;
-	scaledRect = trimRect(scaledRect, 0, 0, _scaledOriImage.width(), _scaledOriImage.height());
-	Mat mRectOriImage, mResizeOri;
-	Mat(ImageConversion::QImage_to_cvMat(*_oriImage, false), rect).copyTo(mRectOriImage);
-	Mat mScaledOriImage = ImageConversion::QImage_to_cvMat(_scaledOriImage, false);
-	cv::resize(mRectOriImage, mResizeOri, cv::Size(scaledRect.width, scaledRect.height),0,0, cv::INTER_NEAREST);
-	mResizeOri.copyTo(Mat(mScaledOriImage, scaledRect));
-	if (_bShowRef)
-		updateShowReferenceImg(rect);
+void Surface::ensureTiles(const QRect& rect)
+{
+	if (_oriImage->isNull() || (_view == VIEW_ORIGINAL && _scaleRatio == 1.0)) return;
+	/*after _ImageDraw.fill(0) it is no longer the level buffer, nothing to render*/
+	if (_ImageDraw.constBits() != _tiles.level(_scaleRatio).constBits()) return;
+	_tiles.takeStaleTiles(_scaleRatio, cv::Rect(rect.x(), rect.y(), rect.width(), rect.height()), _staleTiles);
+	for (size_t i = 0; i < _staleTiles.size(); i++)
+	{
+		renderTile(_staleTiles[i]);
+	}
+}
+
+void Surface::renderTile(const cv::Rect& tile)
+{
+	Mat dst(ImageConversion::QImage_to_cvMat(_tiles.level(_scaleRatio), false), tile);
+	Mat ori = ImageConversion::QImage_to_cvMat(*_oriImage, false);
+	if (_view == VIEW_REFERENCE_ORIGINAL && _referenceOriginalImage)
+	{
+		TilePyramid::sampleNearest(ImageConversion::QImage_to_cvMat(*_referenceOriginalImage, false), _scaleRatio, tile, dst);
+	}
+	else if (_view == VIEW_REFERENCE && _referenceImage)
+	{
+		/*nearest sampling commutes with the per pixel blend, so only the shown pixels are blended*/
+		Mat src, ref;
+		TilePyramid::sampleNearest(ori, _scaleRatio, tile, src);
+		TilePyramid::sampleNearest(ImageConversion::QImage_to_cvMat(*_referenceImage, false), _scaleRatio, tile, ref);
+		if (_drawType == DRAW_TYPE::SUPER_PIXEL_WISE && _referenceOriginalImage)
+		{
+			Mat refOri;
+			TilePyramid::sampleNearest(ImageConversion::QImage_to_cvMat(*_referenceOriginalImage, false), _scaleRatio, tile, refOri);
+			cv::addWeighted(src, blendAlphaSource, refOri, blendAlphaReference, 0, src);
+		}
+		cv::addWeighted(src, blendAlphaSource, ref, blendAlphaReference, 0, dst);
+	}
 	else
 	{
-		Mat mImageDraw = ImageConversion::QImage_to_cvMat(_ImageDraw, false);
-		Mat(mScaledOriImage, scaledRect).copyTo(Mat(mImageDraw, scaledRect));
+		TilePyramid::sampleNearest(ori, _scaleRatio, tile, dst);
 	}
-	qDebug() << "updateRectOfImg ed";
 }
 
 void Surface::zoom(int step, QPoint pt)
@@ -1030,32 +1004,15 @@ double Surface::getZoomRatio()
 	return this->_scaleRatio;
 }
 
-QImage Surface::blendImage(const QImage& img1, double ratio1, const QImage& img2, double ratio2, cv::Rect rect)
-{
-	assert(img1.height() == img2.height() && img1.width() == img2.width());
-	Mat m1 = ImageConversion::QImage_to_cvMat(img1, false);
-	Mat m2 = ImageConversion::QImage_to_cvMat(img2, false);
-	assert(m1.type() == m2.type() && m1.type() == CV_8UC3);
-	
-	if (!rect.empty() && !_blendImage.empty() && _blendImage.size == m1.size&& _blendImage.size == m2.size)
-	{
-		qDebug() << "Partial Change blend";
-		cv::addWeighted(Mat(m1, rect), ratio1, Mat(m2, rect), ratio2, 0, Mat(_blendImage, rect));
-	}
-	else
-	{
-		qDebug() << "Whole Change blend";
-		cv::addWeighted(m1, ratio1, m2, ratio2, 0, _blendImage);
-	}
-	//cv::cvtColor(_blendImage, _blendImage, CV_BGR2RGB);
-	QImage rvt = ImageConversion::cvMat_to_QImage(_blendImage, false, false);
-	return rvt;
-}
-
 void Surface::setBlendAlpha(double source, double reference)
 {
 	blendAlphaSource = source;
 	blendAlphaReference = reference;
+	if (_view == VIEW_REFERENCE)
+	{
+		_tiles.invalidate();
+		update();
+	}
 }
 
 double Surface::getBlendAlphaSource()
@@ -1115,97 +1072,116 @@ void Surface::clearSavedPixels()
 }
 
 
-void Surface::slotPixelCovered(vector<PtrSegmentPoints>* vecPts)
+void Surface::slotPixelCovered(const SegmentIndex* index, vector<int>* segmentIds)
 {
 	//flip color
 	/*_tempVecPoint.assign(vecPts.begin(), vecPts.end());
 	flipColor(_ImageDraw, _tempVecPoint);
 	_bColorFlipped = true;*/
 	//clearSavedPixels();
-//	if (_bColorFlipped == false)
-	_seg_drawn_num = 0;
-	if (!_bLButtonDown)
+	/*hovering shows the segments under the brush only, a drag accumulates them*/
+	if (!_bLButtonDown || index != _segIndex)
 	{
-		_tempVecSegs.clear();
-		_tempVecPoint.clear();
-		_seg_drawn_num = 0;
-	}
-	else
-		_seg_drawn_num = _tempVecSegs.size();
-	/*draw current points*/
-	
-	
-	for (int i = 0; i < vecPts->size(); i++)
-	{
-		if (std::find(_tempVecSegs.begin(), _tempVecSegs.end(), (*vecPts)[i]) == _tempVecSegs.end())
-			_tempVecSegs.push_back((*vecPts)[i]);
-		else
-		{
-			//qDebug() << "Have Same Segs";
-		}
+		clearStroke();
 	}
-	if (_seg_drawn_num < _tempVecSegs.size())
+	_segIndex = index;
+	if (_strokeStamp.size() < size_t(index->size())) _strokeStamp.resize(index->size(), 0);
+	_seg_drawn_num = _tempVecSegs.size();
+	for (int i = 0; i < segmentIds->size(); i++)
 	{
-		_bUpdateClipMat = true;
-	}
-	else
-	{
-		_bUpdateClipMat = false;
+		int segment = (*segmentIds)[i];
+		if (_strokeStamp[segment] == _strokeGeneration) continue;//already in the stroke
+		_strokeStamp[segment] = _strokeGeneration;
+		_tempVecSegs.push_back(segment);
 	}
+	_bUpdateClipMat = _seg_drawn_num < _tempVecSegs.size();
 	if(_bUpdateClipMat)
 	{
-		//qDebug() << "Have Same Segs";
-		std::vector<Point>& refSavePixels = std::get<1>(_savedPixels);
 		Mat& drawIMG = ImageConversion::QImage_to_cvMat(_ImageDraw, false);
+		const cv::Rect imageRect(0, 0, drawIMG.cols, drawIMG.rows);
+		/*grow the clip rect by the scaled boxes of the new segments only*/
+		cv::Rect& r = _savedBoundingRect;
+		cv::Rect grown = _drawClipMat.empty() ? cv::Rect() : r;
 		for (size_t i = _seg_drawn_num; i < _tempVecSegs.size(); i++)
 		{
-			PtrSegmentPoints pSegs = (_tempVecSegs)[i];
-			for (int j = 0; j < pSegs->size(); j++)
-			{
-				Point p = (*pSegs)[j];
-				p *= _scaleRatio;
-				if (p.x >= 0 && p.y >= 0 && p.x < drawIMG.cols&&p.y < drawIMG.rows)
-				{
-					for (int i = 0; i < _scaleRatio; i++)
-					{
-						for (int j = 0; j < _scaleRatio; j++)
-						{
-							_tempVecPoint.push_back(p + Point(j,i));
-						}
-					}
-				}
-			}
+			cv::Rect sr = scaledSegmentRect(index->bbox(_tempVecSegs[i])) & imageRect;
+			if (sr.area() == 0) continue;
+			grown = grown.area() == 0 ? sr : (grown | sr);
 		}
-		cv::Rect& r = _savedBoundingRect;
-		/*if (r.x == 0) qDebug() << "r to the left ";
-		if (r.y == 0) qDebug() << "r to the top ";
-		if (r.x +r.width== drawIMG.cols) qDebug() << "r to the right";
-		if (r.y + r.height == drawIMG.rows) qDebug() << "r to the bottom";
-		if (r.x < 0) qDebug() << "r out of left ";
-		if (r.y < 0) qDebug() << "r out of top ";
-		if (r.x + r.width > drawIMG.cols) qDebug() << "r out of right";
-		if (r.y + r.height > drawIMG.rows) qDebug() << "r out of bottom";*/
-		r = cv::boundingRect(_tempVecPoint);
-
-		Mat(drawIMG, r).copyTo(_drawClipMat);
-		//_drawClipMat.create(r.height, r.width, CV_8UC3); _drawClipMat.setTo(0);
-		for (size_t i = 0; i < _tempVecPoint.size(); i++)
+		if (grown.area() == 0)
 		{
-			Point pt = _tempVecPoint[i] - r.tl();
-
-			_drawClipMat.at<cv::Vec3b>(pt.y, pt.x) = Mat(drawIMG, r).at<cv::Vec3b>(pt.y, pt.x)*_alpha_src
-				+ cv::Vec3b(_myPenColor.red(), _myPenColor.green(), _myPenColor.blue())*_alpha_dst;
-
+			_bUpdateClipMat = false;
+			return;
+		}
+		ensureTiles(QRect(grown.x, grown.y, grown.width, grown.height));
+		if (_drawClipMat.empty() || grown != r)
+		{
+			/*keep the preview blended so far, fresh image pixels around it*/
+			Mat clip;
+			Mat(drawIMG, grown).copyTo(clip);
+			if (!_drawClipMat.empty())
+				_drawClipMat.copyTo(Mat(clip, cv::Rect(r.x - grown.x, r.y - grown.y, r.width, r.height)));
+			_drawClipMat = clip;
+			r = grown;
+		}
+		for (size_t i = _seg_drawn_num; i < _tempVecSegs.size(); i++)
+		{
+			blendSegmentToClip(drawIMG, *index, _tempVecSegs[i]);
 		}
 		this->update(r.x, r.y, r.width, r.height);
-		
-		
-		//qDebug() << "slotPixelCovered";
+	}
+}
 
+void Surface::clearStroke()
+{
+	_tempVecSegs.clear();
+	_seg_drawn_num = 0;
+	_drawClipMat = Mat();
+	if (++_strokeGeneration == 0)
+	{
+		std::fill(_strokeStamp.begin(), _strokeStamp.end(), 0);
+		_strokeGeneration = 1;
+	}
+}
 
+cv::Rect Surface::scaledSegmentRect(const cv::Rect& bbox)
+{
+	/*a pixel p covers p*_scaleRatio .. p*_scaleRatio + n-1, as in blendSegmentToClip*/
+	const int n = int(std::ceil(_scaleRatio));
+	Point tl(bbox.x, bbox.y), br(bbox.x + bbox.width - 1, bbox.y + bbox.height - 1);
+	tl *= _scaleRatio;
+	br *= _scaleRatio;
+	return cv::Rect(tl, br + Point(n, n));
+}
 
+void Surface::blendSegmentToClip(const Mat& drawIMG, const SegmentIndex& index, int segment)
+{
+	const cv::Rect& r = _savedBoundingRect;
+	const int n = int(std::ceil(_scaleRatio));
+	const Vec3b penColor = cv::Vec3b(_myPenColor.red(), _myPenColor.green(), _myPenColor.blue())*_alpha_dst;
+	for (const SegmentRun* run = index.runsBegin(segment); run != index.runsEnd(segment); ++run)
+	{
+		Point p0 = Point(run->x, run->y);
+		p0 *= _scaleRatio;
+		for (int dy = 0; dy < n; dy++)
+		{
+			const int y = p0.y + dy;
+			if (y < r.y || y >= r.y + r.height) continue;
+			const Vec3b* src = drawIMG.ptr<Vec3b>(y);
+			Vec3b* dst = _drawClipMat.ptr<Vec3b>(y - r.y);
+			for (int k = 0; k < run->length; k++)
+			{
+				Point p(run->x + k, run->y);
+				p *= _scaleRatio;
+				for (int dx = 0; dx < n; dx++)
+				{
+					const int x = p.x + dx;
+					if (x < r.x || x >= r.x + r.width) continue;
+					dst[x - r.x] = src[x] * _alpha_src + penColor;
+				}
+			}
+		}
 	}
-
 }
 
 void Surface::restoreSavedPixels(QImage&IMG, SavedPixels& savedPixels)
@@ -1248,6 +1224,13 @@ void Surface::setVecPointsWithinRadiusOfPoint(vector<Point>&vecPts, vector<Point
 	}
 }
 
+int Surface::getBrushRadiusInImage()
+{
+	int radius = _myPenRadius;
+	radius /= _scaleRatio;//as getCircleInnerPoints()
+	return radius;
+}
+
 void Surface::getCircleInnerPoints(vector<Point>&circleInnerPoint, int radius)
 {
 	circleInnerPoint.clear();
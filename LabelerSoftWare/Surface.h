@@ -10,6 +10,7 @@
 #include <tuple>
 #include <SegmentationControl.h>
 #include <chrono>
+#include "TilePyramid.h"
 using cv::Mat;
 using cv::Vec3b;
 using cv::Point;
@@ -21,6 +22,7 @@ class Surface :	public QLabel
 {
 public:
 	enum DRAW_TYPE { PIXEL_WISE, SUPER_PIXEL_WISE }_drawType;
+	enum VIEW_TYPE { VIEW_ORIGINAL, VIEW_REFERENCE, VIEW_REFERENCE_ORIGINAL };//what the display tiles show
 	Q_OBJECT
 public:
 	Surface(const QImage& Img, QWidget*parent = NULL);
@@ -45,13 +47,11 @@ public:
 	void endLabel();
 	void setDrawType(DRAW_TYPE type);
 	double getZoomRatio();
-	/*when image is editable, _ImageDraw is a copy of _oriImage;
-	otherwise,  _ImageDraw and _oriImage are the same.
-	*/
 	bool isEditable();
 	void fitSizeToImage();
 	/*when original image is modified, this should
-	be called to update qimage for drawing*/
+	be called to update qimage for drawing; only the tiles under rect are rendered again,
+	once they are painted*/
 	void updateImage(cv::Rect rect=cv::Rect());
 public:
 	Vec3b getLabelColor();
@@ -67,13 +67,14 @@ signals:
 	void mousePositionShiftedByScale(QPoint mousePt, double oldScaleRatio, double newScaleRatio);
 	void clearResult();
 	void signalPixelCovered(vector<Point>* vecPts);//send out pixel covereded by cursor
-	void signalDrawPixelsToResult(vector<PtrSegmentPoints>*vecPts, QColor color);
+	void signalBrushMoved(int x, int y, int radius);//brush disk in image pixels, super pixel mode
+	void signalDrawPixelsToResult(const SegmentIndex* index, vector<int>* segmentIds, QColor color);
 	void signalSendPolygonDraw(vector<Point> vecPts, QColor clr);
 	void signalChangeSPSegLevel(int diff);
 public slots:
 void changeClass(QString txt, QColor clr);
 void applyScaleRatio();
-void slotPixelCovered(vector<PtrSegmentPoints>* vecPts);//retrieve pixel need to draw
+void slotPixelCovered(const SegmentIndex* index, vector<int>* segmentIds);//retrieve pixel need to draw
 
 private:
 	/*These functions set showing image scale*/
@@ -87,9 +88,16 @@ private:
 	void showReferenceImg();
 	void showReferenceOriginalImg();
 	void updateShowReferenceImg(cv::Rect rect);//rect none scaled original
-	void updateRectOfImg(cv::Rect rect);//rect of true size,correspond to none scaled image
 	void showInternalImg();
-	void showScaledRefImg(const QImage* Img,cv::Rect rect=cv::Rect());
+	/*
+	_ImageDraw is the display buffer of the current scale and view: the original image
+	itself at scale 1 without a reference, a level of _tiles otherwise. Tiles are
+	rendered when they are first painted or read.
+	*/
+	void setView(VIEW_TYPE view);
+	void bindDrawImage();
+	void ensureTiles(const QRect& rect);//rect in display pixels
+	void renderTile(const cv::Rect& tile);
 
 	
 	vector<QPolygon> getMouseCursorTriangles(int penWidth,double angle=5.0);//angle in degree
@@ -107,6 +115,10 @@ private:
 
 	void setVecPointsWithinRadiusOfPoint(vector<Point>&vecPts, vector<Point>&circleInnerPoint, Point center, int width, int height);
 	void getCircleInnerPoints(vector<Point>&circleInnerPoint, int radius);
+	int getBrushRadiusInImage();
+	void clearStroke();//empty _tempVecSegs and the preview clip
+	cv::Rect scaledSegmentRect(const cv::Rect& bbox);//box of a segment on the scaled draw image
+	void blendSegmentToClip(const Mat& drawIMG, const SegmentIndex& index, int segment);//preview of one segment into _drawClipMat
 
 	void flipColor(QImage& IMG, vector<Point>& vecPts);
 	void pushToSavedPixels(QColor& color, Point& Pt);
@@ -118,8 +130,6 @@ private:
 	QPoint getPointAfterNewScale(QPoint pt,double scaleOld,double scaleNew);
 	QPoint FilterScalePoint(QPoint pt);
 
-	QImage blendImage(const QImage& img1, double ratio1, const QImage& img2, double ratio2, cv::Rect rect = cv::Rect());
-
 	vector<Point> transformVecPtsByScaleAndPos(vector<Point>& vecPts, double scale,Point offset);//scale first then offset
 protected:
 	void keyPressEvent(QKeyEvent *ev) Q_DECL_OVERRIDE;
@@ -137,11 +147,12 @@ protected:
 private:
 	std::chrono::time_point<steady_clock> _timePoint;
 	const QImage* _oriImage;//This image will not be changed
-	QImage _scaledOriImage;
 	QImage _ImageDraw;
+	TilePyramid _tiles;
+	VIEW_TYPE _view;
+	vector<cv::Rect> _staleTiles;
 	const QImage* _referenceImage;
 	const QImage* _referenceOriginalImage;
-	Mat _blendImage;
 	bool _bLButtonDown;
 	bool _bShowRef;
 	bool _bSelectClass;
@@ -164,9 +175,11 @@ private:
 	double blendAlphaReference;
 	QPoint _mousePos;
 	vector<Point> _circleInnerPoint;
-	vector<Point> _tempVecPoint;//scaled version
 	vector<Point> _vecPtsToEmit;
-	vector<PtrSegmentPoints> _tempVecSegs;
+	vector<int> _tempVecSegs;//ids of the segments covered by the current stroke
+	const SegmentIndex* _segIndex;//index the ids refer to, owned by the segmentation control
+	vector<unsigned int> _strokeStamp;//segment is in _tempVecSegs when equal to _strokeGeneration
+	unsigned int _strokeGeneration;
 	vector<Point> _rightClickCache;
 	vector<QPolygon> _mouseCursorTriangles;
 	static int _myPenRadius;
@@ -0,0 +1,27 @@
+#include "ThreadPriority.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+ScopedLowPriority::ScopedLowPriority(bool lower)
+{
+	_lowered = false;
+	_previous = 0;
+#ifdef _WIN32
+	if (!lower) return;
+	_previous = GetThreadPriority(GetCurrentThread());
+	//the same level as QThread::LowPriority
+	_lowered = _previous != THREAD_PRIORITY_ERROR_RETURN && _previous > THREAD_PRIORITY_BELOW_NORMAL
+		&& SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL) != 0;
+#endif
+}
+
+ScopedLowPriority::~ScopedLowPriority()
+{
+#ifdef _WIN32
+	if (_lowered) SetThreadPriority(GetCurrentThread(), _previous);
+#endif
+}
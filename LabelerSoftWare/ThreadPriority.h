@@ -0,0 +1,15 @@
+/*Priority of the calling thread lowered for a scope, also for OpenMP workers that Qt does not know about*/
+#pragma once
+
+class ScopedLowPriority
+{
+public:
+	explicit ScopedLowPriority(bool lower = true);//lower = false does nothing, for code shared with foreground runs
+	~ScopedLowPriority();
+private:
+	ScopedLowPriority(const ScopedLowPriority&);
+	ScopedLowPriority& operator=(const ScopedLowPriority&);
+private:
+	bool _lowered;
+	int _previous;
+};
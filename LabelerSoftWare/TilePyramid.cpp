@@ -0,0 +1,147 @@
+#include "TilePyramid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+const int TILE_SIZE = 256;//tile side in display pixels
+const int MAX_LEVELS = 3;//zoom levels kept, the least recently used goes first
+
+TilePyramid::TilePyramid()
+{
+	_width = 0;
+	_height = 0;
+	_format = QImage::Format_RGB888;
+	_useCounter = 0;
+}
+
+void TilePyramid::reset(int width, int height, QImage::Format format)
+{
+	if (width != _width || height != _height || format != _format)
+	{
+		_levels.clear();
+		_width = width;
+		_height = height;
+		_format = format;
+	}
+	else
+	{
+		invalidate();
+	}
+}
+
+QSize TilePyramid::scaledSize(int width, int height, double scale)
+{
+	int w = int(width*scale);
+	int h = int(height*scale);
+	return QSize(w < 1 ? 1 : w, h < 1 ? 1 : h);
+}
+
+int TilePyramid::rankOf(double scale)
+{
+	return int(std::floor(std::log(scale) / std::log(2.0) + 0.5));
+}
+
+TilePyramid::Level& TilePyramid::getLevel(double scale)
+{
+	int rank = rankOf(scale);
+	std::map<int, Level>::iterator it = _levels.find(rank);
+	if (it == _levels.end())
+	{
+		/*make room first, so the evicted buffer is released before the new one is allocated*/
+		while (int(_levels.size()) >= MAX_LEVELS)
+		{
+			std::map<int, Level>::iterator oldest = _levels.begin();
+			for (std::map<int, Level>::iterator l = _levels.begin(); l != _levels.end(); ++l)
+			{
+				if (l->second.lastUse < oldest->second.lastUse) oldest = l;
+			}
+			_levels.erase(oldest);
+		}
+		Level& level = _levels[rank];
+		QSize size = scaledSize(_width, _height, scale);
+		level.image = QImage(size, _format);
+		level.tilesX = (size.width() + TILE_SIZE - 1) / TILE_SIZE;
+		level.tilesY = (size.height() + TILE_SIZE - 1) / TILE_SIZE;
+		level.fresh.assign(level.tilesX*level.tilesY, 0);
+		it = _levels.find(rank);
+	}
+	it->second.lastUse = ++_useCounter;
+	return it->second;
+}
+
+const QImage& TilePyramid::level(double scale)
+{
+	return getLevel(scale).image;
+}
+
+void TilePyramid::invalidate(cv::Rect rect)
+{
+	for (std::map<int, Level>::iterator it = _levels.begin(); it != _levels.end(); ++it)
+	{
+		Level& level = it->second;
+		if (rect.area() <= 0)
+		{
+			std::fill(level.fresh.begin(), level.fresh.end(), 0);
+			continue;
+		}
+		/*display pixel X shows source pixel floor(X/scale)*/
+		double scale = std::pow(2.0, it->first);
+		int x0 = int(std::floor(rect.x*scale)) / TILE_SIZE;
+		int y0 = int(std::floor(rect.y*scale)) / TILE_SIZE;
+		int x1 = int(std::ceil((rect.x + rect.width)*scale)) / TILE_SIZE;
+		int y1 = int(std::ceil((rect.y + rect.height)*scale)) / TILE_SIZE;
+		x0 = std::max(0, x0); y0 = std::max(0, y0);
+		x1 = std::min(level.tilesX - 1, x1); y1 = std::min(level.tilesY - 1, y1);
+		for (int ty = y0; ty <= y1; ty++)
+		{
+			for (int tx = x0; tx <= x1; tx++) level.fresh[ty*level.tilesX + tx] = 0;
+		}
+	}
+}
+
+void TilePyramid::takeStaleTiles(double scale, const cv::Rect& rect, vector<cv::Rect>& tiles)
+{
+	tiles.clear();
+	Level& level = getLevel(scale);
+	const int width = level.image.width();
+	const int height = level.image.height();
+	cv::Rect r = rect & cv::Rect(0, 0, width, height);
+	if (r.area() <= 0) return;
+	for (int ty = r.y / TILE_SIZE; ty <= (r.y + r.height - 1) / TILE_SIZE; ty++)
+	{
+		for (int tx = r.x / TILE_SIZE; tx <= (r.x + r.width - 1) / TILE_SIZE; tx++)
+		{
+			unsigned char& fresh = level.fresh[ty*level.tilesX + tx];
+			if (fresh) continue;
+			fresh = 1;
+			int x = tx*TILE_SIZE;
+			int y = ty*TILE_SIZE;
+			tiles.push_back(cv::Rect(x, y, std::min(TILE_SIZE, width - x), std::min(TILE_SIZE, height - y)));
+		}
+	}
+}
+
+void TilePyramid::sampleNearest(const Mat& src, double scale, const cv::Rect& tile, Mat& dst)
+{
+	if (scale == 1.0)
+	{
+		src(tile & cv::Rect(0, 0, src.cols, src.rows)).copyTo(dst);
+		return;
+	}
+	dst.create(tile.height, tile.width, src.type());
+	const size_t pixelSize = src.elemSize();
+	vector<int> columns(tile.width);
+	for (int x = 0; x < tile.width; x++)
+	{
+		columns[x] = std::min(src.cols - 1, int((tile.x + x) / scale));
+	}
+	for (int y = 0; y < tile.height; y++)
+	{
+		const uchar* s = src.ptr<uchar>(std::min(src.rows - 1, int((tile.y + y) / scale)));
+		uchar* d = dst.ptr<uchar>(y);
+		for (int x = 0; x < tile.width; x++)
+		{
+			memcpy(d + x*pixelSize, s + columns[x] * pixelSize, pixelSize);
+		}
+	}
+}
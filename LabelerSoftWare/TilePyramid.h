@@ -0,0 +1,48 @@
+/*Display buffers of a Surface at its zoom levels, rendered tile by tile on demand*/
+#pragma once
+#include <vector>
+#include <map>
+#include <QImage>
+#include "opencv.hpp"
+using std::vector;
+using cv::Mat;
+
+class TilePyramid
+{
+public:
+	TilePyramid();
+public:
+	/*
+	Source image of width*height pixels. Buffers of another source size are dropped,
+	otherwise every tile becomes stale and the buffers are kept.
+	*/
+	void reset(int width, int height, QImage::Format format);
+	/*display buffer of the scale (source size times scale), created on first use.
+	Its pixels are only meaningful on tiles handed out by takeStaleTiles*/
+	const QImage& level(double scale);
+	/*rect in source pixels, empty for the whole image; marks the tiles of every level it reaches*/
+	void invalidate(cv::Rect rect = cv::Rect());
+	/*stale tiles of the level under rect (display pixels), marked fresh; the caller renders them*/
+	void takeStaleTiles(double scale, const cv::Rect& rect, vector<cv::Rect>& tiles);
+
+	static QSize scaledSize(int width, int height, double scale);
+	/*dst(x, y) = src(x/scale, y/scale) for the pixels of tile, dst has the size of tile*/
+	static void sampleNearest(const Mat& src, double scale, const cv::Rect& tile, Mat& dst);
+private:
+	struct Level
+	{
+		QImage image;
+		vector<unsigned char> fresh;//per tile, row major
+		int tilesX;
+		int tilesY;
+		unsigned int lastUse;
+	};
+	static int rankOf(double scale);
+	Level& getLevel(double scale);
+private:
+	int _width;
+	int _height;
+	QImage::Format _format;
+	std::map<int, Level> _levels;//by log2 of the scale
+	unsigned int _useCounter;
+};